@@ -0,0 +1,139 @@
+//
+// Parquet Bit Packing Kernels
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BIT_PACKING_SIMD
+#endif
+
+#include "bit_packing.h"
+#include "cpu_features.h"
+
+using namespace parquet_file;
+
+namespace {
+
+int const MAX_BIT_WIDTH = 32;
+
+// Accumulates the values in a 64-bit word, storing 32 bits at a time.
+// With the width fixed the loop unrolls to straight shifts and ORs.
+template<int W>
+void
+pack8_scalar(uint32_t const * i_vals, uint8_t * o_out)
+{
+    uint64_t acc = 0;
+    int bits = 0;
+    for (int ndx = 0; ndx < 8; ++ndx) {
+        acc |= uint64_t(i_vals[ndx]) << bits;
+        bits += W;
+        if (bits >= 32) {
+            uint32_t word = uint32_t(acc);
+            memcpy(o_out, &word, sizeof(word));
+            o_out += sizeof(word);
+            acc >>= 32;
+            bits -= 32;
+        }
+    }
+    memcpy(o_out, &acc, bits / 8);
+}
+
+#if defined(BIT_PACKING_SIMD)
+
+// Joins the two halves of a group, 4 * W bits each, into W bytes.
+template<int W>
+inline void
+store_halves(uint64_t i_lo, uint64_t i_hi, uint8_t * o_out)
+{
+    if (W == 16) {
+        memcpy(o_out, &i_lo, 8);
+        memcpy(o_out + 8, &i_hi, 8);
+        return;
+    }
+    // (Masked only to keep the W == 16 instantiation well defined.)
+    uint64_t word = i_lo | (i_hi << (4 * W & 63));
+    memcpy(o_out, &word, W < 8 ? W : 8);
+    if (W > 8) {
+        word = i_hi >> (64 - 4 * W);
+        memcpy(o_out + 8, &word, W - 8);
+    }
+}
+
+// Up to 16 bits wide the whole group fits one register: adjacent
+// values are joined in each 64-bit lane, then adjacent lanes, in two
+// shift and OR steps for all eight at once.
+template<int W>
+__attribute__((target("avx2")))
+void
+pack8_avx2(uint32_t const * i_vals, uint8_t * o_out)
+{
+    __m256i vals = _mm256_loadu_si256((__m256i const *) i_vals);
+    __m256i pairs = _mm256_or_si256(
+        _mm256_and_si256(vals, _mm256_set1_epi64x(0xffffffff)),
+        _mm256_slli_epi64(_mm256_srli_epi64(vals, 32), W));
+    __m256i quads = _mm256_or_si256(
+        pairs, _mm256_slli_epi64(_mm256_srli_si256(pairs, 8), 2 * W));
+    store_halves<W>(_mm256_extract_epi64(quads, 0),
+                    _mm256_extract_epi64(quads, 2),
+                    o_out);
+}
+
+#endif
+
+// Fills the table for widths W and below.
+template<int W>
+struct Kernels
+{
+    static void fill(Pack8Func * o_funcs, bool i_avx2)
+    {
+        o_funcs[W] = pack8_scalar<W>;
+#if defined(BIT_PACKING_SIMD)
+        if (W <= 16 && i_avx2)
+            o_funcs[W] = pack8_avx2<W <= 16 ? W : 16>;
+#endif
+        Kernels<W - 1>::fill(o_funcs, i_avx2);
+    }
+};
+
+template<>
+struct Kernels<0>
+{
+    static void fill(Pack8Func * o_funcs, bool)
+    {
+        o_funcs[0] = pack8_scalar<0>;
+    }
+};
+
+struct KernelTable
+{
+    KernelTable()
+    {
+        bool avx2 = false;
+#if defined(BIT_PACKING_SIMD)
+        avx2 = cpu_has_avx2();
+#endif
+        Kernels<MAX_BIT_WIDTH>::fill(m_funcs, avx2);
+    }
+
+    Pack8Func m_funcs[MAX_BIT_WIDTH + 1];
+};
+
+} // end namespace
+
+namespace parquet_file {
+
+Pack8Func
+pack8_func(int i_bit_width)
+{
+    static KernelTable const table;
+    if (i_bit_width < 0 || i_bit_width > MAX_BIT_WIDTH)
+        return NULL;
+    return table.m_funcs[i_bit_width];
+}
+
+} // end namespace parquet_file
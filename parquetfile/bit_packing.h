@@ -0,0 +1,26 @@
+//
+// Parquet Bit Packing Kernels
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+namespace parquet_file {
+
+// Bit packs a group of 8 values, least significant bit first as the
+// RLE / bit-packing hybrid encoding wants, into exactly i_bit_width
+// bytes at o_out.  The values must fit in i_bit_width bits.
+typedef void (*Pack8Func)(uint32_t const * i_vals, uint8_t * o_out);
+
+// The fastest kernel the CPU has for i_bit_width, NULL above 32.
+Pack8Func pack8_func(int i_bit_width);
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
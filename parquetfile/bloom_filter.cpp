@@ -0,0 +1,275 @@
+//
+// Parquet Split Block Bloom Filter
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLOOM_FILTER_AVX2
+#endif
+
+#include "parquet_types.h"
+
+#include "bloom_filter.h"
+#include "cpu_features.h"
+
+using namespace std;
+using namespace parquet;
+
+using apache::thrift::protocol::TCompactProtocol;
+
+namespace {
+
+uint32_t const SALT[8] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+uint64_t const PRIME1 = 11400714785074694791ULL;
+uint64_t const PRIME2 = 14029467366897019727ULL;
+uint64_t const PRIME3 = 1609587929392839161ULL;
+uint64_t const PRIME4 = 9650029242287828579ULL;
+uint64_t const PRIME5 = 2870177450012600261ULL;
+
+inline uint64_t
+rotl(uint64_t i_val, int i_bits)
+{
+    return (i_val << i_bits) | (i_val >> (64 - i_bits));
+}
+
+inline uint64_t
+read64(uint8_t const * i_ptr)
+{
+    uint64_t val;
+    memcpy(&val, i_ptr, sizeof(val));
+    return val;
+}
+
+inline uint32_t
+read32(uint8_t const * i_ptr)
+{
+    uint32_t val;
+    memcpy(&val, i_ptr, sizeof(val));
+    return val;
+}
+
+inline uint64_t
+xxh_round(uint64_t i_acc, uint64_t i_input)
+{
+    return rotl(i_acc + i_input * PRIME2, 31) * PRIME1;
+}
+
+inline uint64_t
+xxh_merge(uint64_t i_acc, uint64_t i_val)
+{
+    return (i_acc ^ xxh_round(0, i_val)) * PRIME1 + PRIME4;
+}
+
+void
+insert_scalar(uint32_t * io_block, uint32_t i_key)
+{
+    for (int ndx = 0; ndx < 8; ++ndx)
+        io_block[ndx] |= uint32_t(1) << ((i_key * SALT[ndx]) >> 27);
+}
+
+#if defined(BLOOM_FILTER_AVX2)
+
+// The eight bit positions of a key come from one vector multiply,
+// shift and variable shift, and land in the block with a single OR.
+__attribute__((target("avx2")))
+void
+insert_avx2(uint32_t * io_block, uint32_t i_key)
+{
+    __m256i const salt = _mm256_loadu_si256((__m256i const *) SALT);
+    __m256i bits = _mm256_srli_epi32(
+        _mm256_mullo_epi32(_mm256_set1_epi32(i_key), salt), 27);
+    __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), bits);
+    __m256i * block = (__m256i *) io_block;
+    _mm256_storeu_si256(block,
+                        _mm256_or_si256(_mm256_loadu_si256(block), mask));
+}
+
+#endif
+
+typedef void (*InsertFunc)(uint32_t * io_block, uint32_t i_key);
+
+InsertFunc
+select_insert()
+{
+#if defined(BLOOM_FILTER_AVX2)
+    if (parquet_file::cpu_has_avx2())
+        return insert_avx2;
+#endif
+    return insert_scalar;
+}
+
+InsertFunc const g_insert = select_insert();
+
+} // end namespace
+
+namespace parquet_file {
+
+BloomFilter::BloomFilter(size_t i_ndv, double i_fpp)
+    : m_words(optimal_num_bytes(i_ndv, i_fpp) / sizeof(uint32_t))
+    , m_num_blocks(m_words.size() * sizeof(uint32_t) / BLOCK_BYTES)
+{
+}
+
+size_t
+BloomFilter::optimal_num_bytes(size_t i_ndv, double i_fpp)
+{
+    if (i_fpp <= 0.0 || i_fpp >= 1.0) {
+        cerr << "bloom filter false positive rate " << i_fpp
+             << " out of range";
+        exit(1);
+    }
+
+    // Bits needed by a split block filter, rounded up to a power of
+    // two bytes within the bounds readers accept.
+    double bits = -8.0 * i_ndv / log(1.0 - pow(i_fpp, 1.0 / 8));
+    size_t nbytes = MIN_BYTES;
+    while (nbytes < MAX_BYTES && nbytes * 8 < bits)
+        nbytes *= 2;
+    return nbytes;
+}
+
+uint64_t
+BloomFilter::hash(void const * i_ptr, size_t i_size)
+{
+    // XXH64 with a zero seed.
+    uint8_t const * ptr = static_cast<uint8_t const *>(i_ptr);
+    uint8_t const * end = ptr + i_size;
+    uint64_t hh;
+
+    if (i_size >= 32) {
+        uint64_t v1 = PRIME1 + PRIME2;
+        uint64_t v2 = PRIME2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -PRIME1;
+        for (; ptr + 32 <= end; ptr += 32) {
+            v1 = xxh_round(v1, read64(ptr));
+            v2 = xxh_round(v2, read64(ptr + 8));
+            v3 = xxh_round(v3, read64(ptr + 16));
+            v4 = xxh_round(v4, read64(ptr + 24));
+        }
+        hh = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hh = xxh_merge(hh, v1);
+        hh = xxh_merge(hh, v2);
+        hh = xxh_merge(hh, v3);
+        hh = xxh_merge(hh, v4);
+    }
+    else {
+        hh = PRIME5;
+    }
+
+    hh += i_size;
+
+    for (; ptr + 8 <= end; ptr += 8)
+        hh = rotl(hh ^ xxh_round(0, read64(ptr)), 27) * PRIME1 + PRIME4;
+    if (ptr + 4 <= end) {
+        hh = rotl(hh ^ (read32(ptr) * PRIME1), 23) * PRIME2 + PRIME3;
+        ptr += 4;
+    }
+    for (; ptr < end; ++ptr)
+        hh = rotl(hh ^ (*ptr * PRIME5), 11) * PRIME1;
+
+    hh ^= hh >> 33;
+    hh *= PRIME2;
+    hh ^= hh >> 29;
+    hh *= PRIME3;
+    hh ^= hh >> 32;
+    return hh;
+}
+
+void
+BloomFilter::insert(uint64_t i_hash)
+{
+    g_insert(&m_words[block_index(i_hash) * 8], uint32_t(i_hash));
+}
+
+void
+BloomFilter::insert(uint64_t const * i_hashes, size_t i_nhashes)
+{
+    InsertFunc insert_block = g_insert;
+    uint32_t * words = m_words.data();
+    for (size_t ndx = 0; ndx < i_nhashes; ++ndx) {
+        uint64_t hh = i_hashes[ndx];
+        insert_block(&words[block_index(hh) * 8], uint32_t(hh));
+    }
+}
+
+bool
+BloomFilter::find(uint64_t i_hash) const
+{
+    uint32_t const * block = &m_words[block_index(i_hash) * 8];
+    uint32_t key = uint32_t(i_hash);
+    for (int ndx = 0; ndx < 8; ++ndx) {
+        uint32_t mask = uint32_t(1) << ((key * SALT[ndx]) >> 27);
+        if (!(block[ndx] & mask))
+            return false;
+    }
+    return true;
+}
+
+size_t
+BloomFilter::num_bytes() const
+{
+    return m_words.size() * sizeof(uint32_t);
+}
+
+void
+BloomFilter::clear()
+{
+    fill(m_words.begin(), m_words.end(), 0);
+}
+
+size_t
+BloomFilter::write(int fd, TCompactProtocol * protocol) const
+{
+    BloomFilterAlgorithm algorithm;
+    algorithm.__set_BLOCK(SplitBlockAlgorithm());
+    BloomFilterHash hash;
+    hash.__set_XXHASH(XxHash());
+    BloomFilterCompression compression;
+    compression.__set_UNCOMPRESSED(Uncompressed());
+
+    BloomFilterHeader header;
+    header.__set_numBytes(num_bytes());
+    header.__set_algorithm(algorithm);
+    header.__set_hash(hash);
+    header.__set_compression(compression);
+
+    size_t header_size = header.write(protocol);
+
+    // The bitset is little-endian words.
+    ssize_t rv = ::write(fd, m_words.data(), num_bytes());
+    if (rv < 0) {
+        cerr << "bloom filter write failed: " << strerror(errno);
+        exit(1);
+    }
+    else if (rv != num_bytes()) {
+        cerr << "bloom filter write: unexpected size:"
+             << " expecting " << num_bytes() << ", saw " << rv;
+        exit(1);
+    }
+    return header_size + num_bytes();
+}
+
+size_t
+BloomFilter::block_index(uint64_t i_hash) const
+{
+    return ((i_hash >> 32) * m_num_blocks) >> 32;
+}
+
+} // end namespace parquet_file
@@ -0,0 +1,66 @@
+//
+// Parquet Split Block Bloom Filter
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include <thrift/protocol/TCompactProtocol.h>
+
+namespace parquet_file {
+
+class BloomFilter;
+typedef std::shared_ptr<BloomFilter> BloomFilterHandle;
+
+// A split block Bloom filter: 256-bit blocks of eight 32-bit words,
+// each insert setting one bit per word of a single block.  Values
+// are hashed with XXH64 (seed 0) over their PLAIN encoding, less the
+// length prefix of byte arrays.
+class BloomFilter
+{
+public:
+    static size_t const BLOCK_BYTES = 32;
+    static size_t const MIN_BYTES = BLOCK_BYTES;
+    static size_t const MAX_BYTES = 128 * 1024 * 1024;
+
+    // Sized, to a power of two, for i_ndv distinct values at a false
+    // positive rate of i_fpp.
+    BloomFilter(size_t i_ndv, double i_fpp);
+
+    static size_t optimal_num_bytes(size_t i_ndv, double i_fpp);
+
+    static uint64_t hash(void const * i_ptr, size_t i_size);
+
+    void insert(uint64_t i_hash);
+
+    void insert(uint64_t const * i_hashes, size_t i_nhashes);
+
+    bool find(uint64_t i_hash) const;
+
+    size_t num_bytes() const;
+
+    void clear();
+
+    // Writes the header and bitset, returns the number of bytes.
+    size_t write(int fd,
+                 apache::thrift::protocol::TCompactProtocol * protocol) const;
+
+private:
+    size_t block_index(uint64_t i_hash) const;
+
+    std::vector<uint32_t> m_words;
+    size_t m_num_blocks;
+};
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
@@ -0,0 +1,75 @@
+//
+// Parquet Buffer Pool
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include "buffer_pool.h"
+
+using namespace std;
+
+namespace parquet_file {
+
+BufferPool::BufferPool(size_t i_block_size,
+                       size_t i_max_free,
+                       MemoryTrackerHandle const & i_tracker)
+    : m_block_size(i_block_size)
+    , m_max_free(i_max_free)
+    , m_tracker(i_tracker)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    for (uint8_t * block : m_free)
+        delete [] block;
+    if (m_tracker)
+        m_tracker->adjust_retained(-ssize_t(m_free.size() * m_block_size));
+}
+
+size_t
+BufferPool::block_size() const
+{
+    return m_block_size;
+}
+
+uint8_t *
+BufferPool::acquire()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!m_free.empty()) {
+            uint8_t * block = m_free.back();
+            m_free.pop_back();
+            if (m_tracker)
+                m_tracker->adjust_retained(-ssize_t(m_block_size));
+            return block;
+        }
+    }
+    return new uint8_t[m_block_size];
+}
+
+void
+BufferPool::release(uint8_t * i_block)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_free.size() < m_max_free) {
+            m_free.push_back(i_block);
+            if (m_tracker)
+                m_tracker->adjust_retained(m_block_size);
+            return;
+        }
+    }
+    delete [] i_block;
+}
+
+size_t
+BufferPool::num_free() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_free.size();
+}
+
+} // end namespace parquet_file
@@ -0,0 +1,52 @@
+//
+// Parquet Buffer Pool
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+#include "memory_tracker.h"
+
+namespace parquet_file {
+
+// Fixed size blocks shared by many users, recycled rather than freed.
+// The pool keeps up to i_max_free idle blocks, retained by i_tracker
+// (if any) while they wait, and frees any beyond that.
+class BufferPool
+{
+public:
+    BufferPool(size_t i_block_size,
+               size_t i_max_free,
+               MemoryTrackerHandle const & i_tracker);
+
+    ~BufferPool();
+
+    size_t block_size() const;
+
+    uint8_t * acquire();
+
+    void release(uint8_t * i_block);
+
+    // Blocks idle in the pool.
+    size_t num_free() const;
+
+private:
+    size_t m_block_size;
+    size_t m_max_free;
+    MemoryTrackerHandle m_tracker;
+    mutable std::mutex m_mutex;
+    std::vector<uint8_t *> m_free;
+};
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
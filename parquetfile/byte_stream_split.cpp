@@ -0,0 +1,94 @@
+//
+// Parquet BYTE_STREAM_SPLIT Encoding
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include <stdlib.h>
+
+#include <iostream>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "byte_stream_split.h"
+
+using namespace std;
+
+namespace {
+
+#if defined(__SSE2__)
+
+// Transposes 16 values of W bytes.  Number the bytes of the block
+// by (value << log2(W)) | byte; interleaving register r with
+// register r + W/2 moves each byte from index n to index n rotated
+// left one bit.  Four rounds rotate the value number to the bottom,
+// leaving register k holding byte k of all 16 values.
+template<int W>
+inline void
+transpose16(char const * i_src, char * o_dst, size_t i_stride)
+{
+    __m128i regs[2][W];
+    for (int ndx = 0; ndx < W; ++ndx)
+        regs[0][ndx] = _mm_loadu_si128((__m128i const *) (i_src + ndx * 16));
+
+    for (int round = 0; round < 4; ++round) {
+        __m128i const * in = regs[round & 1];
+        __m128i * out = regs[(round + 1) & 1];
+        for (int ndx = 0; ndx < W / 2; ++ndx) {
+            out[2 * ndx] = _mm_unpacklo_epi8(in[ndx], in[ndx + W / 2]);
+            out[2 * ndx + 1] = _mm_unpackhi_epi8(in[ndx], in[ndx + W / 2]);
+        }
+    }
+
+    for (int ndx = 0; ndx < W; ++ndx)
+        _mm_storeu_si128((__m128i *) (o_dst + ndx * i_stride), regs[0][ndx]);
+}
+
+#endif
+
+template<int W>
+void
+split(char const * i_data, size_t i_nvals, char * o_dst)
+{
+    size_t ndx = 0;
+#if defined(__SSE2__)
+    for (; ndx + 16 <= i_nvals; ndx += 16)
+        transpose16<W>(i_data + ndx * W, o_dst + ndx, i_nvals);
+#endif
+    for (; ndx < i_nvals; ++ndx)
+        for (int byte = 0; byte < W; ++byte)
+            o_dst[byte * i_nvals + ndx] = i_data[ndx * W + byte];
+}
+
+} // end namespace
+
+namespace parquet_file {
+
+void
+byte_stream_split(char const * i_data,
+                  size_t i_nvals,
+                  size_t i_width,
+                  string & o_buf)
+{
+    size_t offset = o_buf.size();
+    o_buf.resize(offset + i_nvals * i_width);
+    char * dst = &o_buf[offset];
+
+    switch (i_width) {
+    case 4:
+        split<4>(i_data, i_nvals, dst);
+        break;
+    case 8:
+        split<8>(i_data, i_nvals, dst);
+        break;
+    default:
+        cerr << "byte_stream_split: unsupported width " << i_width;
+        exit(1);
+        break;
+    }
+}
+
+} // end namespace parquet_file
@@ -0,0 +1,28 @@
+//
+// Parquet BYTE_STREAM_SPLIT Encoding
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+namespace parquet_file {
+
+// Appends the i_nvals values of i_width bytes at i_data to o_buf
+// with byte k of every value gathered into stream k, streams stored
+// one after another.  Widths other than 4 and 8 aren't supported.
+void byte_stream_split(char const * i_data,
+                       size_t i_nvals,
+                       size_t i_width,
+                       std::string & o_buf);
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
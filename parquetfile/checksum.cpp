@@ -0,0 +1,172 @@
+//
+// Parquet Page Checksum
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include <zlib.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHECKSUM_PCLMUL
+#endif
+
+#include "checksum.h"
+#include "cpu_features.h"
+
+namespace {
+
+uint32_t
+crc32_zlib(uint8_t const * i_ptr, size_t i_size, uint32_t i_crc)
+{
+    // zlib takes lengths as uInt.
+    while (i_size > 0) {
+        uInt chunk = i_size > (1U << 30) ? (1U << 30) : uInt(i_size);
+        i_crc = crc32(i_crc, i_ptr, chunk);
+        i_ptr += chunk;
+        i_size -= chunk;
+    }
+    return i_crc;
+}
+
+#if defined(CHECKSUM_PCLMUL)
+
+// At least this many bytes before folding pays.
+size_t const PCLMUL_MIN_SIZE = 64;
+
+// Folding constants, in the bit-reflected domain, for the CRC-32
+// polynomial, from Intel's "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction".
+uint64_t const K1K2[] __attribute__((aligned(16))) =
+    { 0x0154442bd4, 0x01c6e41596 };
+uint64_t const K3K4[] __attribute__((aligned(16))) =
+    { 0x01751997d0, 0x00ccaa009e };
+uint64_t const K5K0[] __attribute__((aligned(16))) =
+    { 0x0163cd6124, 0x0000000000 };
+uint64_t const POLY[] __attribute__((aligned(16))) =
+    { 0x01db710641, 0x01f7011641 };
+
+// Four 128-bit lanes fold 64 bytes per step, independent of each
+// other, then fold down to one lane, to 64 bits and Barrett reduce
+// to 32.  Takes the inverted CRC and a multiple of 16 bytes, at
+// least 64.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t
+crc32_pclmul(uint8_t const * i_ptr, size_t i_size, uint32_t i_crc)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((__m128i const *) (i_ptr + 0x00));
+    x2 = _mm_loadu_si128((__m128i const *) (i_ptr + 0x10));
+    x3 = _mm_loadu_si128((__m128i const *) (i_ptr + 0x20));
+    x4 = _mm_loadu_si128((__m128i const *) (i_ptr + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(i_crc));
+    x0 = _mm_load_si128((__m128i const *) K1K2);
+    i_ptr += 64;
+    i_size -= 64;
+
+    while (i_size >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((__m128i const *) (i_ptr + 0x00));
+        y6 = _mm_loadu_si128((__m128i const *) (i_ptr + 0x10));
+        y7 = _mm_loadu_si128((__m128i const *) (i_ptr + 0x20));
+        y8 = _mm_loadu_si128((__m128i const *) (i_ptr + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        i_ptr += 64;
+        i_size -= 64;
+    }
+
+    // Fold the four lanes into one.
+    x0 = _mm_load_si128((__m128i const *) K3K4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Then any remaining 16 byte blocks.
+    while (i_size >= 16) {
+        x2 = _mm_loadu_si128((__m128i const *) i_ptr);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        i_ptr += 16;
+        i_size -= 16;
+    }
+
+    // Fold 128 bits to 64.
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((__m128i const *) K5K0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduce to 32 bits.
+    x0 = _mm_load_si128((__m128i const *) POLY);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return _mm_extract_epi32(x1, 1);
+}
+
+bool const g_has_pclmul = parquet_file::cpu_has_pclmul();
+
+#endif
+
+} // end namespace
+
+namespace parquet_file {
+
+uint32_t
+crc32_checksum(void const * i_ptr, size_t i_size, uint32_t i_crc)
+{
+    uint8_t const * ptr = static_cast<uint8_t const *>(i_ptr);
+
+#if defined(CHECKSUM_PCLMUL)
+    if (g_has_pclmul && i_size >= PCLMUL_MIN_SIZE) {
+        // Whole 16 byte blocks are folded, zlib finishes the tail.
+        size_t folded = i_size & ~size_t(15);
+        i_crc = ~crc32_pclmul(ptr, folded, ~i_crc);
+        ptr += folded;
+        i_size -= folded;
+    }
+#endif
+
+    return crc32_zlib(ptr, i_size, i_crc);
+}
+
+} // end namespace parquet_file
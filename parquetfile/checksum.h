@@ -0,0 +1,25 @@
+//
+// Parquet Page Checksum
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace parquet_file {
+
+// The standard (zlib, gzip) CRC-32 Parquet wants in PageHeader.crc,
+// continued from i_crc.  Folded with carry-less multiplies when the
+// CPU has them.
+uint32_t crc32_checksum(void const * i_ptr, size_t i_size,
+                        uint32_t i_crc = 0);
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
@@ -0,0 +1,454 @@
+//
+// Parquet Column Statistics
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "column_statistics.h"
+
+using namespace std;
+using namespace parquet;
+
+namespace {
+
+// Byte array bounds are cut to this many bytes, so long values don't
+// bloat every page header and index.
+size_t const MAX_BOUND_SIZE = 64;
+
+// Folds i_vals into io_min and io_max.  NaNs compare false and so
+// never displace a floating point min or max.
+template<typename T>
+void
+minmax(T const * i_vals, size_t i_nvals, T & io_min, T & io_max)
+{
+    for (size_t ndx = 0; ndx < i_nvals; ++ndx) {
+        io_min = min(io_min, i_vals[ndx]);
+        io_max = max(io_max, i_vals[ndx]);
+    }
+}
+
+#if defined(__SSE2__)
+
+// SSE2 has no 32 bit min/max; select through compare masks instead.
+// Unsigned values are biased into signed range first.
+void
+minmax_epi32(int32_t const * i_vals,
+             size_t i_nvals,
+             int32_t & io_min,
+             int32_t & io_max,
+             uint32_t i_bias)
+{
+    __m128i const bias = _mm_set1_epi32(i_bias);
+    __m128i vmin = _mm_set1_epi32(io_min ^ i_bias);
+    __m128i vmax = _mm_set1_epi32(io_max ^ i_bias);
+    size_t ndx = 0;
+    for (; ndx + 4 <= i_nvals; ndx += 4) {
+        __m128i val = _mm_xor_si128(
+            _mm_loadu_si128((__m128i const *) (i_vals + ndx)), bias);
+        __m128i lt = _mm_cmplt_epi32(val, vmin);
+        vmin = _mm_or_si128(_mm_and_si128(lt, val),
+                            _mm_andnot_si128(lt, vmin));
+        __m128i gt = _mm_cmpgt_epi32(val, vmax);
+        vmax = _mm_or_si128(_mm_and_si128(gt, val),
+                            _mm_andnot_si128(gt, vmax));
+    }
+
+    int32_t mins[4];
+    int32_t maxs[4];
+    _mm_storeu_si128((__m128i *) mins, vmin);
+    _mm_storeu_si128((__m128i *) maxs, vmax);
+    int32_t bmin = io_min ^ i_bias;
+    int32_t bmax = io_max ^ i_bias;
+    for (int lane = 0; lane < 4; ++lane) {
+        bmin = min(bmin, mins[lane]);
+        bmax = max(bmax, maxs[lane]);
+    }
+    for (; ndx < i_nvals; ++ndx) {
+        bmin = min(bmin, int32_t(i_vals[ndx] ^ i_bias));
+        bmax = max(bmax, int32_t(i_vals[ndx] ^ i_bias));
+    }
+    io_min = bmin ^ i_bias;
+    io_max = bmax ^ i_bias;
+}
+
+template<>
+void
+minmax<int32_t>(int32_t const * i_vals,
+                size_t i_nvals,
+                int32_t & io_min,
+                int32_t & io_max)
+{
+    minmax_epi32(i_vals, i_nvals, io_min, io_max, 0);
+}
+
+template<>
+void
+minmax<uint32_t>(uint32_t const * i_vals,
+                 size_t i_nvals,
+                 uint32_t & io_min,
+                 uint32_t & io_max)
+{
+    int32_t smin = io_min;
+    int32_t smax = io_max;
+    minmax_epi32((int32_t const *) i_vals, i_nvals, smin, smax, 0x80000000);
+    io_min = smin;
+    io_max = smax;
+}
+
+// minps/maxps return their second operand when either is a NaN, so
+// with the accumulator second NaN inputs are skipped.
+template<>
+void
+minmax<float>(float const * i_vals,
+              size_t i_nvals,
+              float & io_min,
+              float & io_max)
+{
+    __m128 vmin = _mm_set1_ps(io_min);
+    __m128 vmax = _mm_set1_ps(io_max);
+    size_t ndx = 0;
+    for (; ndx + 4 <= i_nvals; ndx += 4) {
+        __m128 val = _mm_loadu_ps(i_vals + ndx);
+        vmin = _mm_min_ps(val, vmin);
+        vmax = _mm_max_ps(val, vmax);
+    }
+
+    float mins[4];
+    float maxs[4];
+    _mm_storeu_ps(mins, vmin);
+    _mm_storeu_ps(maxs, vmax);
+    for (int lane = 0; lane < 4; ++lane) {
+        io_min = min(io_min, mins[lane]);
+        io_max = max(io_max, maxs[lane]);
+    }
+    for (; ndx < i_nvals; ++ndx) {
+        io_min = min(io_min, i_vals[ndx]);
+        io_max = max(io_max, i_vals[ndx]);
+    }
+}
+
+template<>
+void
+minmax<double>(double const * i_vals,
+               size_t i_nvals,
+               double & io_min,
+               double & io_max)
+{
+    __m128d vmin = _mm_set1_pd(io_min);
+    __m128d vmax = _mm_set1_pd(io_max);
+    size_t ndx = 0;
+    for (; ndx + 2 <= i_nvals; ndx += 2) {
+        __m128d val = _mm_loadu_pd(i_vals + ndx);
+        vmin = _mm_min_pd(val, vmin);
+        vmax = _mm_max_pd(val, vmax);
+    }
+
+    double mins[2];
+    double maxs[2];
+    _mm_storeu_pd(mins, vmin);
+    _mm_storeu_pd(maxs, vmax);
+    for (int lane = 0; lane < 2; ++lane) {
+        io_min = min(io_min, mins[lane]);
+        io_max = max(io_max, maxs[lane]);
+    }
+    for (; ndx < i_nvals; ++ndx) {
+        io_min = min(io_min, i_vals[ndx]);
+        io_max = max(io_max, i_vals[ndx]);
+    }
+}
+
+#endif
+
+// Initial bounds which any value replaces.
+template<typename T>
+T
+lowest()
+{
+    return numeric_limits<T>::has_infinity
+        ? -numeric_limits<T>::infinity() : numeric_limits<T>::lowest();
+}
+
+template<typename T>
+T
+highest()
+{
+    return numeric_limits<T>::has_infinity
+        ? numeric_limits<T>::infinity() : numeric_limits<T>::max();
+}
+
+// Statistics of fixed width values kept as T.
+template<typename T>
+class FixedColumnStatistics : public parquet_file::ColumnStatistics
+{
+public:
+    FixedColumnStatistics()
+        : ColumnStatistics(is_signed<T>::value || is_same<T, bool>::value)
+    {
+        clear();
+    }
+
+    virtual void update(void const * i_ptr, size_t i_size)
+    {
+        T val;
+        memcpy(&val, i_ptr, sizeof(val));
+        m_min = min(m_min, val);
+        m_max = max(m_max, val);
+    }
+
+    virtual void update_batch(void const * i_vals, size_t i_nvals)
+    {
+        minmax(static_cast<T const *>(i_vals), i_nvals, m_min, m_max);
+    }
+
+    virtual void merge(ColumnStatistics const & i_other)
+    {
+        FixedColumnStatistics const & other =
+            static_cast<FixedColumnStatistics const &>(i_other);
+        m_min = min(m_min, other.m_min);
+        m_max = max(m_max, other.m_max);
+    }
+
+    virtual void clear()
+    {
+        m_min = highest<T>();
+        m_max = lowest<T>();
+    }
+
+    virtual bool min_max(string & o_min, string & o_max) const
+    {
+        // Until a value is seen min is above max.
+        if (m_min > m_max)
+            return false;
+
+        T minval = m_min;
+        T maxval = m_max;
+        // Readers can't know the sign of a zero bound; widen them.
+        if (is_floating_point<T>::value) {
+            if (minval == 0)
+                minval = -T(0);
+            if (maxval == 0)
+                maxval = T(0);
+        }
+        o_min.assign((char const *) &minval, sizeof(T));
+        o_max.assign((char const *) &maxval, sizeof(T));
+        return true;
+    }
+
+    virtual int compare(string const & i_lhs, string const & i_rhs) const
+    {
+        T lhs;
+        T rhs;
+        memcpy(&lhs, i_lhs.data(), sizeof(T));
+        memcpy(&rhs, i_rhs.data(), sizeof(T));
+        return lhs < rhs ? -1 : rhs < lhs ? 1 : 0;
+    }
+
+private:
+    T m_min;
+    T m_max;
+};
+
+// Byte arrays sort as unsigned bytes, which is how string compares.
+class ByteArrayColumnStatistics : public parquet_file::ColumnStatistics
+{
+public:
+    ByteArrayColumnStatistics()
+        : ColumnStatistics(false)
+        , m_has_values(false)
+    {
+    }
+
+    virtual void update(void const * i_ptr, size_t i_size)
+    {
+        char const * ptr = static_cast<char const *>(i_ptr);
+        if (!m_has_values) {
+            m_min.assign(ptr, i_size);
+            m_max.assign(ptr, i_size);
+            m_has_values = true;
+            return;
+        }
+        if (m_min.compare(0, string::npos, ptr, i_size) > 0)
+            m_min.assign(ptr, i_size);
+        else if (m_max.compare(0, string::npos, ptr, i_size) < 0)
+            m_max.assign(ptr, i_size);
+    }
+
+    virtual void update_batch(void const * i_vals, size_t i_nvals)
+    {
+        cerr << "update_batch: BYTE_ARRAY values have no fixed width";
+        exit(1);
+    }
+
+    virtual void merge(ColumnStatistics const & i_other)
+    {
+        ByteArrayColumnStatistics const & other =
+            static_cast<ByteArrayColumnStatistics const &>(i_other);
+        if (!other.m_has_values)
+            return;
+        update(other.m_min.data(), other.m_min.size());
+        update(other.m_max.data(), other.m_max.size());
+    }
+
+    virtual void clear()
+    {
+        m_min.clear();
+        m_max.clear();
+        m_has_values = false;
+    }
+
+    virtual bool min_max(string & o_min, string & o_max) const
+    {
+        if (!m_has_values)
+            return false;
+
+        // A cut max is rounded up to remain a bound; when it can't be,
+        // there are no bounds.
+        o_min.assign(m_min, 0, min(m_min.size(), MAX_BOUND_SIZE));
+        o_max = m_max;
+        if (o_max.size() > MAX_BOUND_SIZE) {
+            o_max.resize(MAX_BOUND_SIZE);
+            while (!o_max.empty() && uint8_t(o_max.back()) == 0xff)
+                o_max.erase(o_max.size() - 1);
+            if (o_max.empty())
+                return false;
+            o_max[o_max.size() - 1] = char(uint8_t(o_max.back()) + 1);
+        }
+        return true;
+    }
+
+    virtual int compare(string const & i_lhs, string const & i_rhs) const
+    {
+        return i_lhs.compare(i_rhs);
+    }
+
+private:
+    string m_min;
+    string m_max;
+    bool m_has_values;
+};
+
+// INT96 timestamps, decimal byte arrays and intervals don't sort as
+// their bytes do; rather than write bounds readers would misuse, they
+// get none at all.
+class UnorderedColumnStatistics : public parquet_file::ColumnStatistics
+{
+public:
+    UnorderedColumnStatistics()
+        : ColumnStatistics(false)
+    {
+    }
+
+    virtual void update(void const * i_ptr, size_t i_size)
+    {
+    }
+
+    virtual void update_batch(void const * i_vals, size_t i_nvals)
+    {
+    }
+
+    virtual void merge(ColumnStatistics const & i_other)
+    {
+    }
+
+    virtual void clear()
+    {
+    }
+
+    virtual bool min_max(string & o_min, string & o_max) const
+    {
+        return false;
+    }
+
+    virtual int compare(string const & i_lhs, string const & i_rhs) const
+    {
+        return 0;
+    }
+};
+
+bool
+is_unsigned_type(ConvertedType::type i_converted_type)
+{
+    switch (i_converted_type) {
+    case ConvertedType::UINT_8:
+    case ConvertedType::UINT_16:
+    case ConvertedType::UINT_32:
+    case ConvertedType::UINT_64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // end namespace
+
+namespace parquet_file {
+
+ColumnStatisticsHandle
+ColumnStatistics::create(Type::type i_data_type,
+                         ConvertedType::type i_converted_type)
+{
+    bool is_unsigned = is_unsigned_type(i_converted_type);
+    switch (i_data_type) {
+    case Type::BOOLEAN:
+        return make_shared<FixedColumnStatistics<bool> >();
+    case Type::INT32:
+        if (is_unsigned)
+            return make_shared<FixedColumnStatistics<uint32_t> >();
+        return make_shared<FixedColumnStatistics<int32_t> >();
+    case Type::INT64:
+        if (is_unsigned)
+            return make_shared<FixedColumnStatistics<uint64_t> >();
+        return make_shared<FixedColumnStatistics<int64_t> >();
+    case Type::FLOAT:
+        return make_shared<FixedColumnStatistics<float> >();
+    case Type::DOUBLE:
+        return make_shared<FixedColumnStatistics<double> >();
+    case Type::INT96:
+        return make_shared<UnorderedColumnStatistics>();
+    default:
+        if (i_converted_type == ConvertedType::DECIMAL ||
+            i_converted_type == ConvertedType::INTERVAL)
+            return make_shared<UnorderedColumnStatistics>();
+        return make_shared<ByteArrayColumnStatistics>();
+    }
+}
+
+ColumnStatistics::ColumnStatistics(bool i_signed)
+    : m_signed(i_signed)
+{
+}
+
+ColumnStatistics::~ColumnStatistics()
+{
+}
+
+void
+ColumnStatistics::get(Statistics & o_stats) const
+{
+    string minval;
+    string maxval;
+    if (!min_max(minval, maxval))
+        return;
+
+    o_stats.__set_min_value(minval);
+    o_stats.__set_max_value(maxval);
+    if (m_signed) {
+        o_stats.__set_min(minval);
+        o_stats.__set_max(maxval);
+    }
+}
+
+} // end namespace parquet_file
@@ -0,0 +1,66 @@
+//
+// Parquet Column Statistics
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "parquet_types.h"
+
+namespace parquet_file {
+
+class ColumnStatistics;
+typedef std::shared_ptr<ColumnStatistics> ColumnStatisticsHandle;
+
+// Running min and max of a column's values, compared the way the
+// column's logical type sorts.  Null counts are kept by the column.
+class ColumnStatistics
+{
+public:
+    static ColumnStatisticsHandle
+    create(parquet::Type::type i_data_type,
+           parquet::ConvertedType::type i_converted_type);
+
+    virtual ~ColumnStatistics();
+
+    // Account for a value as passed to ParquetColumn::add_datum.
+    virtual void update(void const * i_ptr, size_t i_size) = 0;
+
+    // Account for i_nvals fixed width values.
+    virtual void update_batch(void const * i_vals, size_t i_nvals) = 0;
+
+    virtual void merge(ColumnStatistics const & i_other) = 0;
+
+    virtual void clear() = 0;
+
+    // PLAIN encoded (without length for BYTE_ARRAY) min and max,
+    // false if no values have been seen.  Long byte arrays give
+    // truncated bounds rather than the values themselves.
+    virtual bool min_max(std::string & o_min, std::string & o_max) const = 0;
+
+    // Compares two values as returned by min_max.
+    virtual int compare(std::string const & i_lhs,
+                        std::string const & i_rhs) const = 0;
+
+    // Sets min_value and max_value, and also the deprecated min and
+    // max when the type sorts signed.
+    void get(parquet::Statistics & o_stats) const;
+
+protected:
+    ColumnStatistics(bool i_signed);
+
+    bool m_signed;
+};
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
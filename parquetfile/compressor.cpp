@@ -8,10 +8,16 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <memory>
 
+#include <brotli/encode.h>
+#include <lz4.h>
 #include <snappy.h>
 #include <zlib.h>
+#include <zstd.h>
 
 #include "compressor.h"
 
@@ -20,9 +26,125 @@ using namespace parquet;
 
 namespace parquet_file {
 
-Compressor::Compressor(parquet::CompressionCodec::type i_compression_codec)
+namespace {
+
+// Defaults for level 0.  Brotli's own default (11) is far too slow
+// to spend on every page.
+int const DEF_ZSTD_LEVEL = 3;
+int const DEF_BROTLI_QUALITY = 5;
+
+} // end namespace
+
+CodecPolicy::CodecPolicy()
+    : m_candidates({CodecLevel(CompressionCodec::SNAPPY, 0),
+                    CodecLevel(CompressionCodec::LZ4_RAW, 0),
+                    CodecLevel(CompressionCodec::ZSTD, 1),
+                    CodecLevel(CompressionCodec::ZSTD, 3),
+                    CodecLevel(CompressionCodec::GZIP, 0)})
+    , m_sample_pages(4)
+    , m_cpu_weight(0.01)
+    , m_max_ratio(0.9)
+{
+}
+
+Compressor::Compressor(parquet::CompressionCodec::type i_compression_codec,
+                       int i_level)
     : m_compression_codec(i_compression_codec)
+    , m_level(i_level)
+    , m_zstream(NULL)
+    , m_zstd_cctx(NULL)
+{
+    switch (m_compression_codec) {
+    case CompressionCodec::UNCOMPRESSED:
+    case CompressionCodec::SNAPPY:
+    case CompressionCodec::GZIP:
+    case CompressionCodec::ZSTD:
+    case CompressionCodec::LZ4_RAW:
+    case CompressionCodec::BROTLI:
+        break;
+    default:
+        cerr << "unsupported compression codec: " << int(m_compression_codec);
+        exit(1);
+        break;
+    }
+}
+
+Compressor::~Compressor()
+{
+    release();
+}
+
+void
+Compressor::release()
+{
+    if (m_zstream) {
+        deflateEnd(m_zstream);
+        delete m_zstream;
+        m_zstream = NULL;
+    }
+    if (m_zstd_cctx) {
+        ZSTD_freeCCtx(m_zstd_cctx);
+        m_zstd_cctx = NULL;
+    }
+}
+
+Compressor &
+Compressor::thread_compressor(parquet::CompressionCodec::type i_compression_codec,
+                              int i_level)
+{
+    typedef map<pair<int, int>, unique_ptr<Compressor> > CompressorMap;
+    static thread_local CompressorMap compressors;
+
+    unique_ptr<Compressor> & compressor =
+        compressors[make_pair(int(i_compression_codec), i_level)];
+    if (!compressor)
+        compressor.reset(new Compressor(i_compression_codec, i_level));
+    return *compressor;
+}
+
+CodecLevel
+Compressor::choose(vector<string> const & i_samples,
+                   CodecPolicy const & i_policy)
 {
+    size_t raw_size = 0;
+    for (string const & sample : i_samples)
+        raw_size += sample.size();
+
+    CodecLevel best(CompressionCodec::UNCOMPRESSED, 0);
+    if (raw_size == 0)
+        return best;
+
+    double best_score = 1.0;
+    double best_ratio = 1.0;
+    vector<string> ins;
+    string out;
+    for (CodecLevel const & candidate : i_policy.m_candidates) {
+        Compressor & compressor =
+            thread_compressor(candidate.first, candidate.second);
+        size_t compressed_size = 0;
+        // Compressing may consume its input, so copy the samples first,
+        // outside the timing.
+        ins = i_samples;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (string & in : ins) {
+            compressor.compress(in, out);
+            compressed_size += out.size();
+        }
+        chrono::nanoseconds elapsed = chrono::steady_clock::now() - start;
+
+        double ratio = double(compressed_size) / raw_size;
+        double score =
+            ratio + i_policy.m_cpu_weight * elapsed.count() / raw_size;
+        if (score < best_score) {
+            best = candidate;
+            best_score = score;
+            best_ratio = ratio;
+        }
+    }
+
+    if (best_ratio > i_policy.m_max_ratio)
+        best = CodecLevel(CompressionCodec::UNCOMPRESSED, 0);
+    return best;
 }
 
 void
@@ -48,36 +170,106 @@ Compressor::compress(std::string & in, std::string & out)
             out.assign(m_tmp.begin(), m_tmp.end());
         }
         break;
-        
+
     case CompressionCodec::GZIP:
         {
-            int window_bits = 15 + 16; // maximum window + GZIP
-            z_stream stream;
-            memset(&stream, '\0', sizeof(stream));
-            int rv = deflateInit2(&stream,
-                                  Z_DEFAULT_COMPRESSION,
+            int rv;
+            if (!m_zstream) {
+                int window_bits = 15 + 16; // maximum window + GZIP
+                m_zstream = new z_stream;
+                memset(m_zstream, '\0', sizeof(*m_zstream));
+                rv = deflateInit2(m_zstream,
+                                  m_level ? m_level : Z_DEFAULT_COMPRESSION,
                                   Z_DEFLATED,
                                   window_bits,
                                   9,
                                   Z_DEFAULT_STRATEGY);
-            if (rv != Z_OK) {
-                cerr << "deflateInit2 failed: " << rv;
-                exit(1);
+                if (rv != Z_OK) {
+                    cerr << "deflateInit2 failed: " << rv;
+                    exit(1);
+                }
             }
-            m_tmp.resize(deflateBound(&stream, in.size()));
-            stream.next_in =
+            else {
+                deflateReset(m_zstream);
+            }
+            m_tmp.resize(deflateBound(m_zstream, in.size()));
+            m_zstream->next_in =
                 const_cast<Bytef*>(reinterpret_cast<const Bytef*>(in.data()));
-            stream.avail_in = in.size();
-            stream.next_out = (Bytef*) m_tmp.data();
-            stream.avail_out = m_tmp.size();
-            rv = deflate(&stream, Z_FINISH);
+            m_zstream->avail_in = in.size();
+            m_zstream->next_out = (Bytef*) m_tmp.data();
+            m_zstream->avail_out = m_tmp.size();
+            rv = deflate(m_zstream, Z_FINISH);
             if (rv != Z_STREAM_END) {
                 cerr << "gzip deflate failed: " << rv;
                 exit(1);
             }
 
-            out.assign(m_tmp.begin(), m_tmp.begin() + stream.total_out);
-            deflateEnd(&stream);
+            out.assign(m_tmp.begin(), m_tmp.begin() + m_zstream->total_out);
+        }
+        break;
+
+    case CompressionCodec::ZSTD:
+        {
+            if (!m_zstd_cctx) {
+                m_zstd_cctx = ZSTD_createCCtx();
+                if (!m_zstd_cctx) {
+                    cerr << "ZSTD_createCCtx failed";
+                    exit(1);
+                }
+            }
+            m_tmp.resize(ZSTD_compressBound(in.size()));
+            size_t rv = ZSTD_compressCCtx(m_zstd_cctx,
+                                          (char *) m_tmp.data(),
+                                          m_tmp.size(),
+                                          in.data(),
+                                          in.size(),
+                                          m_level ? m_level : DEF_ZSTD_LEVEL);
+            if (ZSTD_isError(rv)) {
+                cerr << "zstd compress failed: " << ZSTD_getErrorName(rv);
+                exit(1);
+            }
+            out.assign(m_tmp.begin(), m_tmp.begin() + rv);
+        }
+        break;
+
+    case CompressionCodec::LZ4_RAW:
+        {
+            // The level is LZ4's acceleration, higher is faster.
+            if (m_lz4_state.empty())
+                m_lz4_state.resize(LZ4_sizeofState());
+            m_tmp.resize(LZ4_compressBound(in.size()));
+            int rv = LZ4_compress_fast_extState((char *) m_lz4_state.data(),
+                                                in.data(),
+                                                (char *) m_tmp.data(),
+                                                in.size(),
+                                                m_tmp.size(),
+                                                m_level > 0 ? m_level : 1);
+            if (rv <= 0) {
+                cerr << "lz4 compress failed: " << rv;
+                exit(1);
+            }
+            out.assign(m_tmp.begin(), m_tmp.begin() + rv);
+        }
+        break;
+
+    case CompressionCodec::BROTLI:
+        {
+            // The one-shot encoder; a brotli encoder instance can't be
+            // reset for the next page.
+            size_t compressed_size =
+                BrotliEncoderMaxCompressedSize(in.size());
+            m_tmp.resize(compressed_size);
+            if (!BrotliEncoderCompress(m_level ? m_level : DEF_BROTLI_QUALITY,
+                                       BROTLI_DEFAULT_WINDOW,
+                                       BROTLI_MODE_GENERIC,
+                                       in.size(),
+                                       (uint8_t const *) in.data(),
+                                       &compressed_size,
+                                       (uint8_t *) m_tmp.data())) {
+                cerr << "brotli compress failed";
+                exit(1);
+            }
+            out.assign(m_tmp.begin(), m_tmp.begin() + compressed_size);
         }
         break;
 
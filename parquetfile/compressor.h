@@ -8,24 +8,73 @@
 #pragma once
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "parquet_types.h"
 
+struct z_stream_s;
+struct ZSTD_CCtx_s;
+
 namespace parquet_file {
 
+typedef std::pair<parquet::CompressionCodec::type, int> CodecLevel;
+typedef std::vector<CodecLevel> CodecLevelSeq;
+
+// Controls how a column chunk's codec is chosen by trial compressing
+// its first pages.  Each candidate scores its compressed / raw size
+// plus m_cpu_weight for every nanosecond it spends per raw byte; the
+// lowest score wins.
+struct CodecPolicy
+{
+    CodecPolicy();
+
+    CodecLevelSeq m_candidates;		// Codecs and levels to try
+    size_t m_sample_pages;		// Pages sampled per column chunk
+    double m_cpu_weight;		// Score per ns per byte
+    double m_max_ratio;			// Worse stays UNCOMPRESSED
+};
+
 class Compressor
 {
 public:
-    Compressor(parquet::CompressionCodec::type i_compression_codec);
+    // The level is codec specific, 0 picks a default suited to
+    // compressing a page at a time.
+    Compressor(parquet::CompressionCodec::type i_compression_codec,
+               int i_level = 0);
+
+    ~Compressor();
 
     void compress(std::string & in, std::string & out);
 
+    // A compressor kept by the calling thread, so pool workers and
+    // the writing thread reuse their codec contexts from page to page,
+    // and from column to column.
+    static Compressor & thread_compressor
+        (parquet::CompressionCodec::type i_compression_codec, int i_level);
+
+    // Trial compress the samples with each of the policy's candidates
+    // and return the best, UNCOMPRESSED if none of them pays off.
+    static CodecLevel choose(std::vector<std::string> const & i_samples,
+                             CodecPolicy const & i_policy);
+
 private:
+    // Not copyable, the codec contexts are ours alone.
+    Compressor(Compressor const &);
+    Compressor & operator=(Compressor const &);
+
+    void release();
+
     parquet::CompressionCodec::type m_compression_codec;
+    int m_level;
     std::string m_tmp;
+
+    // Created on first use and reused for every page after.
+    z_stream_s * m_zstream;
+    ZSTD_CCtx_s * m_zstd_cctx;
+    std::string m_lz4_state;
 };
-    
+
 } // end namespace parquet_file
 
 // Local Variables:
@@ -0,0 +1,63 @@
+//
+// Parquet CPU Feature Detection
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include "cpu_features.h"
+
+namespace {
+
+struct CpuFeatures
+{
+    CpuFeatures()
+        : m_avx2(false)
+        , m_sse42(false)
+        , m_pclmul(false)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        // We may run ahead of the CPU model's own static initialization.
+        __builtin_cpu_init();
+        m_avx2 = __builtin_cpu_supports("avx2");
+        m_sse42 = __builtin_cpu_supports("sse4.2");
+        m_pclmul = __builtin_cpu_supports("pclmul") &&
+            __builtin_cpu_supports("sse4.1");
+#endif
+    }
+
+    bool m_avx2;
+    bool m_sse42;
+    bool m_pclmul;
+};
+
+CpuFeatures const &
+cpu_features()
+{
+    static CpuFeatures const features;
+    return features;
+}
+
+} // end namespace
+
+namespace parquet_file {
+
+bool
+cpu_has_avx2()
+{
+    return cpu_features().m_avx2;
+}
+
+bool
+cpu_has_sse42()
+{
+    return cpu_features().m_sse42;
+}
+
+bool
+cpu_has_pclmul()
+{
+    return cpu_features().m_pclmul;
+}
+
+} // end namespace parquet_file
@@ -0,0 +1,26 @@
+//
+// Parquet CPU Feature Detection
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+namespace parquet_file {
+
+// Instruction set extensions the kernels choose between at run time.
+// The CPU is probed once, on first use, and may be asked from static
+// initializers.  Always false off x86.
+bool cpu_has_avx2();
+
+bool cpu_has_sse42();
+
+// Carry-less multiply, along with the SSE4.1 it is used with.
+bool cpu_has_pclmul();
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
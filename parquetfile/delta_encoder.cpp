@@ -0,0 +1,183 @@
+//
+// Parquet Delta Encoders
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include <string.h>
+
+#include <algorithm>
+#include <type_traits>
+
+#include "delta_encoder.h"
+
+using namespace std;
+
+namespace {
+
+void
+put_uleb128(string & o_buf, uint64_t i_val)
+{
+    while (i_val >= 0x80) {
+        o_buf.push_back(char((i_val & 0x7f) | 0x80));
+        i_val >>= 7;
+    }
+    o_buf.push_back(char(i_val));
+}
+
+void
+put_zigzag(string & o_buf, int64_t i_val)
+{
+    put_uleb128(o_buf, (uint64_t(i_val) << 1) ^ uint64_t(i_val >> 63));
+}
+
+// Packs 32 values of W bits each, LSB first, into 4 * W bytes.  The
+// bit width is a template parameter so the loop unrolls into straight
+// line shifts and ors with constant offsets.
+template<int W>
+void
+pack32(uint64_t const * i_vals, uint8_t * o_ptr)
+{
+    uint64_t words[W / 2 + 1] = { 0 };
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8
+    // Older compilers reject the pragma; the constant bound still
+    // lets them unroll the loop on their own.
+#pragma GCC unroll 32
+#endif
+    for (int ndx = 0; ndx < 32; ++ndx) {
+        int const bit = ndx * W;
+        int const shift = bit % 64;
+        words[bit / 64] |= i_vals[ndx] << shift;
+        if (shift + W > 64)
+            words[bit / 64 + 1] |= (i_vals[ndx] >> 1) >> (63 - shift);
+    }
+    memcpy(o_ptr, words, 4 * W);
+}
+
+typedef void (*Pack32Func)(uint64_t const *, uint8_t *);
+
+#define PACK32_8(base)                                                  \
+    pack32<base + 0>, pack32<base + 1>, pack32<base + 2>, pack32<base + 3>, \
+    pack32<base + 4>, pack32<base + 5>, pack32<base + 6>, pack32<base + 7>
+
+Pack32Func const g_pack32[65] = {
+    PACK32_8(0), PACK32_8(8), PACK32_8(16), PACK32_8(24),
+    PACK32_8(32), PACK32_8(40), PACK32_8(48), PACK32_8(56),
+    pack32<64>
+};
+
+#undef PACK32_8
+
+} // end namespace
+
+namespace parquet_file {
+
+DeltaBinaryPackedEncoder::DeltaBinaryPackedEncoder()
+{
+}
+
+template<typename T>
+void
+DeltaBinaryPackedEncoder::encode(T const * i_vals,
+                                 size_t i_nvals,
+                                 string & o_buf)
+{
+    // Deltas wrap around in the width of the column's type.
+    typedef typename make_unsigned<T>::type U;
+
+    put_uleb128(o_buf, BLOCK_SIZE);
+    put_uleb128(o_buf, MINIBLOCKS);
+    put_uleb128(o_buf, i_nvals);
+    put_zigzag(o_buf, i_nvals ? int64_t(i_vals[0]) : 0);
+
+    for (size_t start = 1; start < i_nvals; start += BLOCK_SIZE) {
+        size_t nvals = min(BLOCK_SIZE, i_nvals - start);
+
+        T min_delta = 0;
+        for (size_t ndx = 0; ndx < nvals; ++ndx) {
+            T delta = T(U(i_vals[start + ndx]) - U(i_vals[start + ndx - 1]));
+            m_deltas[ndx] = U(delta);
+            if (ndx == 0 || delta < min_delta)
+                min_delta = delta;
+        }
+        for (size_t ndx = 0; ndx < nvals; ++ndx)
+            m_deltas[ndx] = U(U(m_deltas[ndx]) - U(min_delta));
+        // A partial last miniblock is padded out to full size.
+        fill(m_deltas + nvals, m_deltas + BLOCK_SIZE, 0);
+
+        put_zigzag(o_buf, int64_t(min_delta));
+
+        // Unused miniblocks in the last block have a zero bit width
+        // and no data.
+        int bitwidths[MINIBLOCKS];
+        for (size_t mb = 0; mb < MINIBLOCKS; ++mb) {
+            uint64_t bits = 0;
+            uint64_t const * deltas = m_deltas + mb * MINIBLOCK_SIZE;
+            for (size_t ndx = 0; ndx < MINIBLOCK_SIZE; ++ndx)
+                bits |= deltas[ndx];
+            bitwidths[mb] = bits ? 64 - __builtin_clzll(bits) : 0;
+            o_buf.push_back(char(bitwidths[mb]));
+        }
+
+        for (size_t mb = 0; mb * MINIBLOCK_SIZE < nvals; ++mb) {
+            size_t offset = o_buf.size();
+            o_buf.resize(offset + 4 * bitwidths[mb]);
+            g_pack32[bitwidths[mb]](m_deltas + mb * MINIBLOCK_SIZE,
+                                    (uint8_t *) &o_buf[offset]);
+        }
+    }
+}
+
+template void DeltaBinaryPackedEncoder::encode<int32_t>(int32_t const *,
+                                                        size_t,
+                                                        string &);
+template void DeltaBinaryPackedEncoder::encode<int64_t>(int64_t const *,
+                                                        size_t,
+                                                        string &);
+
+void
+DeltaByteArrayEncoder::encode_lengths(int32_t const * i_lens,
+                                      size_t i_nvals,
+                                      char const * i_data,
+                                      string & o_buf)
+{
+    m_int_enc.encode(i_lens, i_nvals, o_buf);
+
+    size_t datasz = 0;
+    for (size_t ndx = 0; ndx < i_nvals; ++ndx)
+        datasz += i_lens[ndx];
+    o_buf.append(i_data, datasz);
+}
+
+void
+DeltaByteArrayEncoder::encode_prefixes(int32_t const * i_lens,
+                                       size_t i_nvals,
+                                       char const * i_data,
+                                       string & o_buf)
+{
+    m_prefix_lens.resize(i_nvals);
+    m_suffix_lens.resize(i_nvals);
+    m_suffixes.clear();
+
+    char const * prev = i_data;
+    size_t prevlen = 0;
+    for (size_t ndx = 0; ndx < i_nvals; ++ndx) {
+        size_t len = i_lens[ndx];
+        size_t maxpfx = min(len, prevlen);
+        size_t pfx = 0;
+        while (pfx < maxpfx && prev[pfx] == i_data[pfx])
+            ++pfx;
+        m_prefix_lens[ndx] = pfx;
+        m_suffix_lens[ndx] = len - pfx;
+        m_suffixes.append(i_data + pfx, len - pfx);
+        prev = i_data;
+        prevlen = len;
+        i_data += len;
+    }
+
+    m_int_enc.encode(m_prefix_lens.data(), i_nvals, o_buf);
+    encode_lengths(m_suffix_lens.data(), i_nvals, m_suffixes.data(), o_buf);
+}
+
+} // end namespace parquet_file
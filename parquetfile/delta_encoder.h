@@ -0,0 +1,68 @@
+//
+// Parquet Delta Encoders
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace parquet_file {
+
+// DELTA_BINARY_PACKED encoding of INT32 and INT64 values.  Each block
+// of deltas is stored as a zigzag min-delta and four miniblocks of
+// (delta - min-delta) bit-packed at the miniblock's own bit width.
+class DeltaBinaryPackedEncoder
+{
+public:
+    DeltaBinaryPackedEncoder();
+
+    // Appends the encoding of i_nvals values to o_buf.
+    template<typename T>
+    void encode(T const * i_vals, size_t i_nvals, std::string & o_buf);
+
+    static size_t const BLOCK_SIZE = 128;
+    static size_t const MINIBLOCKS = 4;
+    static size_t const MINIBLOCK_SIZE = BLOCK_SIZE / MINIBLOCKS;
+
+private:
+    uint64_t m_deltas[BLOCK_SIZE];
+};
+
+// DELTA_LENGTH_BYTE_ARRAY and DELTA_BYTE_ARRAY encodings.  Both take
+// i_nvals values stored back to back in i_data with their lengths
+// in i_lens.
+class DeltaByteArrayEncoder
+{
+public:
+    // Delta packed lengths followed by the concatenated values.
+    void encode_lengths(int32_t const * i_lens,
+                        size_t i_nvals,
+                        char const * i_data,
+                        std::string & o_buf);
+
+    // Delta packed lengths of the prefix each value shares with its
+    // predecessor, followed by the remaining suffixes encoded as
+    // DELTA_LENGTH_BYTE_ARRAY.
+    void encode_prefixes(int32_t const * i_lens,
+                         size_t i_nvals,
+                         char const * i_data,
+                         std::string & o_buf);
+
+private:
+    DeltaBinaryPackedEncoder m_int_enc;
+    std::vector<int32_t> m_prefix_lens;
+    std::vector<int32_t> m_suffix_lens;
+    std::string m_suffixes;
+};
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
@@ -5,55 +5,211 @@
 // All rights reserved.
 //
 
+#include <stdint.h>
+#include <string.h>
+
+#include <limits>
+
+#if defined(__x86_64__)
+#include "util/sse-util.h"
+#define DICTIONARY_CRC_HASH
+#endif
+
+#include "cpu_features.h"
 #include "dictionary_encoder.h"
 
 using namespace std;
+using namespace parquet;
+
+namespace {
+
+size_t const MIN_SLOTS = 256;
+
+#if defined(DICTIONARY_CRC_HASH)
+
+bool const g_have_sse42 = parquet_file::cpu_has_sse42();
+
+uint32_t
+crc_hash(uint8_t const * i_ptr, size_t i_size)
+{
+    uint32_t hash = 0;
+    for (; i_size >= sizeof(uint32_t); i_size -= sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, i_ptr, sizeof(word));
+        hash = impala::SSE4_crc32_u32(hash, word);
+        i_ptr += sizeof(uint32_t);
+    }
+    for (; i_size > 0; --i_size)
+        hash = impala::SSE4_crc32_u8(hash, *i_ptr++);
+    // The low order bits pick the slot, make sure the last bytes
+    // hashed affect them.
+    return (hash << 16) | (hash >> 16);
+}
+
+#endif
+
+uint32_t
+fnv_hash(uint8_t const * i_ptr, size_t i_size)
+{
+    uint32_t hash = 2166136261U;
+    for (; i_size > 0; --i_size) {
+        hash ^= *i_ptr++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+} // end namespace
 
 namespace parquet_file {
 
+DictionaryEncoderHandle
+DictionaryEncoder::create(Type::type i_data_type)
+{
+    switch (i_data_type) {
+    case Type::INT32:
+    case Type::FLOAT:
+        return make_shared<FixedDictionaryEncoder<uint32_t> >();
+    case Type::INT64:
+    case Type::DOUBLE:
+        return make_shared<FixedDictionaryEncoder<uint64_t> >();
+    default:
+        return make_shared<ByteArrayDictionaryEncoder>();
+    }
+}
+
 DictionaryEncoder::DictionaryEncoder()
     : m_nvals(0)
-    , m_map(MAX_NVALS)
+    , m_max_bytes(numeric_limits<size_t>::max())
+    , m_allow_overflow(false)
+{
+}
+
+DictionaryEncoder::~DictionaryEncoder()
+{
+}
+
+void
+DictionaryEncoder::set_max_bytes(size_t i_max_bytes)
+{
+    m_max_bytes = i_max_bytes;
+}
+
+void
+DictionaryEncoder::allow_overflow(bool i_allow)
+{
+    m_allow_overflow = i_allow;
+}
+
+ByteArrayDictionaryEncoder::ByteArrayDictionaryEncoder()
 {
 }
 
 uint32_t
-DictionaryEncoder::encode_datum(void const * i_ptr,
+ByteArrayDictionaryEncoder::encode_datum(void const * i_ptr,
                                 size_t i_size,
                                 bool i_isvarlen)
     throw(overflow_error)
 {
-    string val(static_cast<char const *>(i_ptr),
-               static_cast<char const *>(i_ptr) + i_size);
+    // Keep the table at most half full.
+    if ((m_nvals + 1) * 2 > m_slots.size())
+        grow();
 
-    auto pos = m_map.find(val);
-    if (pos != m_map.end()) {
-        return pos->second;
-    }
-    else {
-        if (m_nvals >= MAX_NVALS)
-            throw overflow_error("too many encoded values");
-        
-        if (i_isvarlen) {
-            uint32_t len = i_size;
-            uint8_t * lenptr = (uint8_t *) &len;
-            m_data.insert(m_data.end(), lenptr, lenptr + sizeof(len));
+    uint32_t hash = ByteArrayDictionaryEncoder::hash(i_ptr, i_size);
+    size_t mask = m_slots.size() - 1;
+    for (size_t pos = hash & mask; true; pos = (pos + 1) & mask) {
+        Slot & slot = m_slots[pos];
+        if (slot.m_ndx == EMPTY) {
+            size_t entry_size = i_isvarlen ? i_size + 4 : i_size;
+            if (!m_allow_overflow &&
+                (m_nvals >= MAX_NVALS ||
+                 m_data.size() + entry_size > m_max_bytes))
+                throw overflow_error("too many encoded values");
+
+            if (i_isvarlen) {
+                uint32_t len = i_size;
+                uint8_t * lenptr = (uint8_t *) &len;
+                m_data.insert(m_data.end(), lenptr, lenptr + sizeof(len));
+            }
+            Entry entry = { uint32_t(m_data.size()), uint32_t(i_size) };
+            m_data.insert(m_data.end(),
+                          static_cast<char const *>(i_ptr),
+                          static_cast<char const *>(i_ptr) + i_size);
+            m_entries.push_back(entry);
+
+            slot.m_hash = hash;
+            slot.m_ndx = m_nvals++;
+            return slot.m_ndx;
+        }
+        if (slot.m_hash == hash) {
+            Entry const & entry = m_entries[slot.m_ndx];
+            if (entry.m_size == i_size &&
+                memcmp(m_data.data() + entry.m_offset, i_ptr, i_size) == 0)
+                return slot.m_ndx;
         }
-        m_data.insert(m_data.end(),
-                      static_cast<char const *>(i_ptr),
-                      static_cast<char const *>(i_ptr) + i_size);
-        uint32_t ndx = m_nvals++;
-        m_map.insert(make_pair(val, ndx));
-        return ndx;
     }
 }
 
 void
-DictionaryEncoder::clear()
+ByteArrayDictionaryEncoder::clear()
 {
+    // Storage is given back, the table regrows as needed.
     m_nvals = 0;
-    m_data.clear();
-    m_map.clear();
+    string().swap(m_data);
+    EntrySeq().swap(m_entries);
+    SlotSeq().swap(m_slots);
+}
+
+char const *
+ByteArrayDictionaryEncoder::data() const
+{
+    return m_data.data();
+}
+
+size_t
+ByteArrayDictionaryEncoder::data_size() const
+{
+    return m_data.size();
+}
+
+size_t
+ByteArrayDictionaryEncoder::memory_usage() const
+{
+    return m_data.capacity() +
+        m_slots.capacity() * sizeof(Slot) +
+        m_entries.capacity() * sizeof(Entry);
+}
+
+uint32_t
+ByteArrayDictionaryEncoder::hash(void const * i_ptr, size_t i_size)
+{
+    uint8_t const * ptr = static_cast<uint8_t const *>(i_ptr);
+#if defined(DICTIONARY_CRC_HASH)
+    if (g_have_sse42)
+        return crc_hash(ptr, i_size);
+#endif
+    return fnv_hash(ptr, i_size);
+}
+
+void
+ByteArrayDictionaryEncoder::grow()
+{
+    SlotSeq slots;
+    slots.swap(m_slots);
+
+    Slot empty = { 0, EMPTY };
+    m_slots.assign(max(MIN_SLOTS, slots.size() * 2), empty);
+
+    // Reinsert using the saved hashes, no need to touch the keys.
+    size_t mask = m_slots.size() - 1;
+    for (Slot const & slot : slots) {
+        if (slot.m_ndx == EMPTY)
+            continue;
+        size_t pos = slot.m_hash & mask;
+        while (m_slots[pos].m_ndx != EMPTY)
+            pos = (pos + 1) & mask;
+        m_slots[pos] = slot;
+    }
 }
 
 } // end namespace parquet_file
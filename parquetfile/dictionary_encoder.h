@@ -8,34 +8,263 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
 
+#include <algorithm>
+#include <memory>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <vector>
+
+#include "parquet_types.h"
 
 namespace parquet_file {
 
-typedef std::unordered_map<std::string, uint32_t> ValueIndexMap;
+class DictionaryEncoder;
+typedef std::shared_ptr<DictionaryEncoder> DictionaryEncoderHandle;
 
 class DictionaryEncoder
 {
 public:
-    DictionaryEncoder();
+    // Returns an encoder suited to the column's physical type.
+    static DictionaryEncoderHandle create(parquet::Type::type i_data_type);
 
-    uint32_t encode_datum(void const * i_ptr, size_t i_size, bool i_isvarlen)
-        throw(std::overflow_error);
+    virtual ~DictionaryEncoder();
+
+    virtual uint32_t encode_datum(void const * i_ptr,
+                                  size_t i_size,
+                                  bool i_isvarlen)
+        throw(std::overflow_error) = 0;
+
+    // Empties the dictionary, freeing its storage.
+    virtual void clear() = 0;
+
+    // The PLAIN encoded dictionary page contents.
+    virtual char const * data() const = 0;
+
+    virtual size_t data_size() const = 0;
+
+    // Bytes held, hash table included.
+    virtual size_t memory_usage() const = 0;
+
+    // Entries which would grow the dictionary page beyond i_max_bytes
+    // overflow the dictionary.
+    void set_max_bytes(size_t i_max_bytes);
 
-    void clear();
+    // While allowed, new entries are added past MAX_NVALS and the
+    // byte limit instead of overflowing.
+    void allow_overflow(bool i_allow);
 
     static size_t const MAX_NVALS = 40 * 1000;
     
     size_t m_nvals;
+
+protected:
+    DictionaryEncoder();
+
+    size_t m_max_bytes;
+    bool m_allow_overflow;
+};
+
+// Dictionary of variable length values, hashed as byte strings.
+class ByteArrayDictionaryEncoder : public DictionaryEncoder
+{
+public:
+    ByteArrayDictionaryEncoder();
+
+    virtual uint32_t encode_datum(void const * i_ptr,
+                                  size_t i_size,
+                                  bool i_isvarlen)
+        throw(std::overflow_error);
+
+    virtual void clear();
+
+    virtual char const * data() const;
+
+    virtual size_t data_size() const;
+
+    virtual size_t memory_usage() const;
+
+private:
+    // Open addressing hash table, the keys themselves live in m_data.
+    struct Slot
+    {
+        uint32_t m_hash;
+        uint32_t m_ndx;
+    };
+    typedef std::vector<Slot> SlotSeq;
+
+    // Location of each dictionary value in m_data.
+    struct Entry
+    {
+        uint32_t m_offset;
+        uint32_t m_size;
+    };
+    typedef std::vector<Entry> EntrySeq;
+
+    static uint32_t const EMPTY = 0xffffffff;
+
+    static uint32_t hash(void const * i_ptr, size_t i_size);
+
+    void grow();
+
     std::string m_data;
+    SlotSeq m_slots;
+    EntrySeq m_entries;
+};
+
+// Unsigned integer type used as the dictionary key for fixed width
+// values of a given size; floating point values are keyed by their
+// bit patterns.
+template<size_t N> struct DictionaryKey;
+template<> struct DictionaryKey<4> { typedef uint32_t type; };
+template<> struct DictionaryKey<8> { typedef uint64_t type; };
+
+// Dictionary of fixed width values.  Keys are stored inline in the
+// hash table and the dictionary page is written straight from the
+// array of values.
+template<typename K>
+class FixedDictionaryEncoder : public DictionaryEncoder
+{
+public:
+    FixedDictionaryEncoder();
+
+    inline uint32_t encode(K i_key) throw(std::overflow_error);
+
+    virtual uint32_t encode_datum(void const * i_ptr,
+                                  size_t i_size,
+                                  bool i_isvarlen)
+        throw(std::overflow_error);
+
+    virtual void clear();
+
+    virtual char const * data() const;
+
+    virtual size_t data_size() const;
+
+    virtual size_t memory_usage() const;
 
 private:
-    ValueIndexMap m_map;
+    struct Slot
+    {
+        K m_key;
+        uint32_t m_ndx;
+    };
+    typedef std::vector<Slot> SlotSeq;
+
+    static uint32_t const EMPTY = 0xffffffff;
+
+    static size_t const MIN_SLOTS = 256;
+
+    static inline uint32_t hash(K i_key)
+    {
+        // Fibonacci hashing, the multiply spreads sequential ids.
+        return uint32_t((uint64_t(i_key) * 0x9e3779b97f4a7c15ULL) >> 32);
+    }
+
+    void grow();
+
+    SlotSeq m_slots;
+    std::vector<K> m_values;
 };
 
+template<typename K>
+FixedDictionaryEncoder<K>::FixedDictionaryEncoder()
+{
+}
+
+template<typename K>
+inline uint32_t
+FixedDictionaryEncoder<K>::encode(K i_key)
+    throw(std::overflow_error)
+{
+    // Keep the table at most half full.
+    if ((m_nvals + 1) * 2 > m_slots.size())
+        grow();
+
+    size_t mask = m_slots.size() - 1;
+    for (size_t pos = hash(i_key) & mask; true; pos = (pos + 1) & mask) {
+        Slot & slot = m_slots[pos];
+        if (slot.m_ndx == EMPTY) {
+            if (!m_allow_overflow &&
+                (m_nvals >= MAX_NVALS ||
+                 data_size() + sizeof(K) > m_max_bytes))
+                throw std::overflow_error("too many encoded values");
+            m_values.push_back(i_key);
+            slot.m_key = i_key;
+            slot.m_ndx = m_nvals++;
+            return slot.m_ndx;
+        }
+        if (slot.m_key == i_key)
+            return slot.m_ndx;
+    }
+}
+
+template<typename K>
+uint32_t
+FixedDictionaryEncoder<K>::encode_datum(void const * i_ptr,
+                                        size_t i_size,
+                                        bool i_isvarlen)
+    throw(std::overflow_error)
+{
+    K key;
+    memcpy(&key, i_ptr, sizeof(key));
+    return encode(key);
+}
+
+template<typename K>
+void
+FixedDictionaryEncoder<K>::clear()
+{
+    // Storage is given back, the table regrows as needed.
+    m_nvals = 0;
+    std::vector<K>().swap(m_values);
+    SlotSeq().swap(m_slots);
+}
+
+template<typename K>
+char const *
+FixedDictionaryEncoder<K>::data() const
+{
+    return reinterpret_cast<char const *>(m_values.data());
+}
+
+template<typename K>
+size_t
+FixedDictionaryEncoder<K>::data_size() const
+{
+    return m_values.size() * sizeof(K);
+}
+
+template<typename K>
+size_t
+FixedDictionaryEncoder<K>::memory_usage() const
+{
+    return m_slots.capacity() * sizeof(Slot) +
+        m_values.capacity() * sizeof(K);
+}
+
+template<typename K>
+void
+FixedDictionaryEncoder<K>::grow()
+{
+    SlotSeq slots;
+    slots.swap(m_slots);
+
+    Slot empty = { 0, EMPTY };
+    m_slots.assign(std::max(MIN_SLOTS, slots.size() * 2), empty);
+
+    size_t mask = m_slots.size() - 1;
+    for (Slot const & slot : slots) {
+        if (slot.m_ndx == EMPTY)
+            continue;
+        size_t pos = hash(slot.m_key) & mask;
+        while (m_slots[pos].m_ndx != EMPTY)
+            pos = (pos + 1) & mask;
+        m_slots[pos] = slot;
+    }
+}
+
 } // end namespace parquet_file
 
 // Local Variables:
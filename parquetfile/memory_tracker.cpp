@@ -0,0 +1,105 @@
+//
+// Parquet Memory Tracker
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include "memory_tracker.h"
+
+using namespace std;
+
+namespace parquet_file {
+
+MemoryTracker::MemoryTracker(size_t i_budget)
+    : m_budget(i_budget)
+    , m_usage(0)
+    , m_retained(0)
+{
+}
+
+MemoryTrackerHandle const &
+MemoryTracker::process()
+{
+    static MemoryTrackerHandle const tracker = make_shared<MemoryTracker>(0);
+    return tracker;
+}
+
+void
+MemoryTracker::set_budget(size_t i_budget)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_budget = i_budget;
+    }
+    m_released.notify_all();
+}
+
+size_t
+MemoryTracker::budget() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_budget;
+}
+
+size_t
+MemoryTracker::usage() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_usage;
+}
+
+void
+MemoryTracker::adjust(ssize_t i_bytes)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (i_bytes < 0 && size_t(-i_bytes) > m_usage - m_retained)
+            m_usage = m_retained;
+        else
+            m_usage += i_bytes;
+    }
+    if (i_bytes < 0)
+        m_released.notify_all();
+}
+
+void
+MemoryTracker::adjust_retained(ssize_t i_bytes)
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (i_bytes < 0 && size_t(-i_bytes) > m_retained)
+            i_bytes = -ssize_t(m_retained);
+        m_retained += i_bytes;
+        m_usage += i_bytes;
+    }
+    if (i_bytes < 0)
+        m_released.notify_all();
+}
+
+size_t
+MemoryTracker::flushable() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_usage - m_retained;
+}
+
+bool
+MemoryTracker::over_budget() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    return m_budget && m_usage - m_retained > m_budget;
+}
+
+bool
+MemoryTracker::wait_for_room(chrono::milliseconds i_timeout)
+{
+    unique_lock<mutex> lock(m_mutex);
+    while (m_budget && m_usage - m_retained > m_budget) {
+        if (m_released.wait_for(lock, i_timeout) == cv_status::timeout)
+            return false;
+    }
+    return true;
+}
+
+} // end namespace parquet_file
@@ -0,0 +1,69 @@
+//
+// Parquet Memory Tracker
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace parquet_file {
+
+class MemoryTracker;
+typedef std::shared_ptr<MemoryTracker> MemoryTrackerHandle;
+
+// Accounts the bytes held by writers against a budget shared by all
+// of them.  Writers report their usage as it changes and, once the
+// budget is exceeded, flush what they hold and wait for room.  Bytes
+// no flush can free are retained: counted in the usage, but not held
+// against the budget.
+class MemoryTracker
+{
+public:
+    // A zero budget is unlimited.
+    MemoryTracker(size_t i_budget);
+
+    // The tracker shared by all the writers in the process, unlimited
+    // until given a budget.
+    static MemoryTrackerHandle const & process();
+
+    void set_budget(size_t i_budget);
+
+    size_t budget() const;
+
+    size_t usage() const;
+
+    // Adds i_bytes to the usage, or takes them off when negative.
+    void adjust(ssize_t i_bytes);
+
+    // As adjust, for retained bytes.
+    void adjust_retained(ssize_t i_bytes);
+
+    // The usage less the retained bytes.
+    size_t flushable() const;
+
+    bool over_budget() const;
+
+    // Waits for the usage to fall within budget, or for i_timeout to
+    // pass without any bytes being released.  Returns whether it is
+    // within budget.
+    bool wait_for_room(std::chrono::milliseconds i_timeout);
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+    size_t m_budget;
+    size_t m_usage;
+    size_t m_retained;
+};
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
@@ -6,21 +6,85 @@
 //
 
 #include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 
+#include <thrift/transport/TBufferTransports.h>
+
 #include "parquet_types.h"
 
 #include "util/bit-util.h"
 #include "util/rle-encoding.h"
 
+#include "checksum.h"
 #include "parquet_column.h"
 
 using namespace std;
 using namespace parquet;
 
 using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+
+namespace {
+
+// Conservative count of values which can still be Put to an RLE
+// encoder with an i_bufsz byte buffer before it fills.  The worst
+// case is (bitwidth + 2) bits per value: bit-packed literals plus
+// their indicator bytes, or back-to-back 8 value repeated runs.
+size_t
+rle_capacity(impala::RleEncoder & enc, size_t i_bufsz, int i_bitwidth)
+{
+    size_t used =
+        enc.len() + 2 * impala::RleEncoder::MinBufferSize(i_bitwidth);
+    if (enc.IsFull() || used >= i_bufsz)
+        return 0;
+    return (i_bufsz - used) * 8 / (i_bitwidth + 2);
+}
+
+// Encodes i_count repeats of i_value as a single RLE run: the count,
+// shifted past the run type bit, as a ULEB128 varint, then the value
+// in whole little-endian bytes.
+size_t
+rle_run(uint8_t * o_buf, size_t i_count, int i_value, int i_bitwidth)
+{
+    size_t len = 0;
+    uint32_t header = uint32_t(i_count) << 1;
+    do {
+        uint8_t byte = header & 0x7f;
+        header >>= 7;
+        if (header)
+            byte |= 0x80;
+        o_buf[len++] = byte;
+    } while (header);
+    for (int ndx = 0; ndx < (i_bitwidth + 7) / 8; ++ndx)
+        o_buf[len++] = uint8_t(i_value >> (8 * ndx));
+    return len;
+}
+
+size_t
+fixed_width(Type::type i_data_type)
+{
+    switch (i_data_type) {
+    case Type::INT32:
+    case Type::FLOAT:
+        return 4;
+    case Type::INT64:
+    case Type::DOUBLE:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+} // end namespace
 
 namespace parquet_file {
 
@@ -42,21 +106,198 @@ ParquetColumn::ParquetColumn(StringSeq const & i_path,
     , m_encoding(i_encoding)
     , m_encodings({i_encoding})
     , m_compression_codec(i_compression_codec)
-    , m_compressor(i_compression_codec)
+    , m_compression_level(0)
+    , m_auto_codec(false)
+    , m_codec_chosen(true)
+    , m_data_page_v2(false)
+    , m_page_index(false)
+    , m_page_checksum(false)
     , m_num_page_values(0)
-    , m_rep_enc(m_rep_buf, sizeof(m_rep_buf),
-                impala::BitUtil::Log2(i_maxreplvl + 1))
-    , m_def_enc(m_def_buf, sizeof(m_def_buf),
-                impala::BitUtil::Log2(i_maxdeflvl + 1))
-    , m_val_enc(m_val_buf, sizeof(m_val_buf), 16)
+    , m_num_page_nulls(0)
+    , m_num_page_recs(0)
+    , m_page_first_row(0)
+    , m_rep_enc(NULL, 0, impala::BitUtil::Log2(i_maxreplvl + 1))
+    , m_def_enc(NULL, 0, impala::BitUtil::Log2(i_maxdeflvl + 1))
+    , m_has_buffers(false)
+    , m_rep_buf(NULL)
+    , m_def_buf(NULL)
+    , m_val_buf(NULL)
+    , m_null_run(0)
+    , m_null_run_replvl(0)
+    , m_null_run_deflvl(0)
+    , m_rep_run_len(0)
+    , m_def_run_len(0)
+    , m_val_bitwidth(0)
+    , m_val_len(0)
     , m_bool_buf(0)
     , m_bool_cnt(0)
+    , m_bool_enc(NULL, 0, 1)
     , m_num_rowgrp_recs(0)
     , m_num_rowgrp_values(0)
-    , m_column_write_offset(-1L)
     , m_uncompressed_size(0)
     , m_compressed_size(0)
+    , m_num_gathered_pages(0)
+    , m_pending_size(0)
+    , m_held_page_size(0)
+    , m_num_rowgrp_nulls(0)
+    , m_page_stats(ColumnStatistics::create(i_data_type, i_converted_type))
+    , m_chunk_stats(ColumnStatistics::create(i_data_type, i_converted_type))
+    , m_dict_enc(DictionaryEncoder::create(i_data_type))
+    , m_bloom_ndv(0)
+    , m_bloom_fpp(0.0)
+    , m_dict_num_values(0)
+    , m_dict_plain_size(0)
+    , m_dict_next_check(0)
+    , m_fallback_pending(false)
+    , m_buf_size(PAGE_SIZE)
+    , m_page_bytes(PAGE_SIZE)
+    , m_seen_uncompressed(0)
+    , m_seen_compressed(0)
+    , m_compression_ratio(1.0)
+    , m_rowgrp_total(NULL)
+    , m_estimated_size(0)
+{
+    switch (i_encoding) {
+    case Encoding::DELTA_BINARY_PACKED:
+        if (i_data_type != Type::INT32 && i_data_type != Type::INT64) {
+            cerr << "DELTA_BINARY_PACKED requires INT32 or INT64: "
+                 << path_string();
+            exit(1);
+        }
+        break;
+    case Encoding::RLE:
+        if (i_data_type != Type::BOOLEAN) {
+            cerr << "RLE requires BOOLEAN: " << path_string();
+            exit(1);
+        }
+        break;
+    case Encoding::BYTE_STREAM_SPLIT:
+        if (i_data_type != Type::FLOAT && i_data_type != Type::DOUBLE) {
+            cerr << "BYTE_STREAM_SPLIT requires FLOAT or DOUBLE: "
+                 << path_string();
+            exit(1);
+        }
+        break;
+    case Encoding::DELTA_LENGTH_BYTE_ARRAY:
+    case Encoding::DELTA_BYTE_ARRAY:
+        if (i_data_type != Type::BYTE_ARRAY) {
+            cerr << "encoding " << int(i_encoding)
+                 << " requires BYTE_ARRAY: " << path_string();
+            exit(1);
+        }
+        break;
+    default:
+        break;
+    }
+
+    set_dictionary_policy(DictionaryPolicy());
+    set_page_policy(PagePolicy());
+}
+
+ParquetColumn::~ParquetColumn()
+{
+    release_buffers();
+}
+
+PageIndex::PageIndex()
+    : m_has_column_index(true)
+{
+}
+
+DictionaryPolicy::DictionaryPolicy()
+    : m_max_bytes(1024 * 1024)
+    , m_max_value_size(numeric_limits<size_t>::max())
+    , m_check_interval(10 * 1000)
+    , m_max_distinct_ratio(0.5)
+{
+}
+
+void
+ParquetColumn::set_dictionary_policy(DictionaryPolicy const & i_policy)
+{
+    m_dict_policy = i_policy;
+    m_dict_enc->set_max_bytes(i_policy.m_max_bytes);
+    m_dict_next_check = m_dict_num_values + i_policy.m_check_interval;
+}
+
+PagePolicy::PagePolicy()
+    : m_max_bytes(64 * 1024)
+    , m_max_rows(0)
+    , m_compressed(false)
+{
+}
+
+void
+ParquetColumn::set_page_policy(PagePolicy const & i_policy)
+{
+    if (i_policy.m_max_bytes < MIN_PAGE_SIZE) {
+        cerr << "set_page_policy: " << path_string() << " page size "
+             << i_policy.m_max_bytes << " is below " << MIN_PAGE_SIZE;
+        exit(1);
+    }
+
+    m_page_policy = i_policy;
+    m_page_bytes = i_policy.m_max_bytes;
+    if (!m_has_buffers)
+        m_buf_size = max(size_t(PAGE_SIZE), i_policy.m_max_bytes);
+}
+
+void
+ParquetColumn::set_data_page_v2(bool i_data_page_v2)
 {
+    m_data_page_v2 = i_data_page_v2;
+}
+
+void
+ParquetColumn::set_page_index(bool i_page_index)
+{
+    m_page_index = i_page_index;
+}
+
+void
+ParquetColumn::set_page_checksum(bool i_page_checksum)
+{
+    m_page_checksum = i_page_checksum;
+}
+
+void
+ParquetColumn::set_bloom_filter(size_t i_ndv, double i_fpp)
+{
+    if (m_data_type == Type::BOOLEAN) {
+        cerr << "set_bloom_filter: " << path_string()
+             << " is BOOLEAN, a Bloom filter can't help";
+        exit(1);
+    }
+
+    m_bloom_ndv = i_ndv;
+    m_bloom_fpp = i_fpp;
+    m_bloom_filter = make_shared<BloomFilter>(i_ndv, i_fpp);
+}
+
+void
+ParquetColumn::set_compression_level(int i_level)
+{
+    m_compression_level = i_level;
+}
+
+void
+ParquetColumn::set_codec_policy(CodecPolicy const & i_policy)
+{
+    m_codec_policy = i_policy;
+    m_auto_codec = true;
+    m_codec_chosen = false;
+}
+
+void
+ParquetColumn::set_compression_pool(ThreadPoolHandle const & i_pool)
+{
+    m_compression_pool = i_pool;
+}
+
+void
+ParquetColumn::set_spill_file(SpillFileHandle const & i_spill_file)
+{
+    m_spill_file = i_spill_file;
 }
 
 void
@@ -76,21 +317,40 @@ ParquetColumn::add_datum(void const * i_ptr,
     uint32_t enc_val = 0;
     size_t check_size = 0;
     if (i_ptr) {
+        if (m_encoding == Encoding::PLAIN_DICTIONARY)
+            check_dict(i_replvl == 0);
+
         switch (m_encoding) {
         case Encoding::PLAIN:
+        case Encoding::DELTA_BINARY_PACKED:
+        case Encoding::BYTE_STREAM_SPLIT:
+        case Encoding::DELTA_LENGTH_BYTE_ARRAY:
+        case Encoding::DELTA_BYTE_ARRAY:
             check_size = i_size;
             break;
         case Encoding::PLAIN_DICTIONARY:
+            if (i_size > m_dict_policy.m_max_value_size &&
+                !defer_fallback(i_replvl)) {
+                // Not worth hashing, and unlikely to repeat.
+                fallback_to_plain();
+                check_size = i_size;
+                break;
+            }
             try {
-                enc_val = m_dict_enc.encode_datum(i_ptr, i_size, i_isvarlen);
-                check_size = 0; // We don't use conventional buffer space.
+                enc_val = m_dict_enc->encode_datum(i_ptr, i_size, i_isvarlen);
             }
             catch (overflow_error const & ex) {
                 // We've overflowed the dictionary, fallback to PLAIN.
-                finalize_page();
-                m_encoding = Encoding::PLAIN;
-                m_encodings.push_back(Encoding::PLAIN);
+                if (!defer_fallback(i_replvl)) {
+                    fallback_to_plain();
+                    check_size = i_size;
+                    break;
+                }
+                enc_val = m_dict_enc->encode_datum(i_ptr, i_size, i_isvarlen);
             }
+            check_size = 0; // We don't use conventional buffer space.
+            ++m_dict_num_values;
+            m_dict_plain_size += i_isvarlen ? i_size + 4 : i_size;
             break;
         default:
             cerr << "unsupported encoding: " << int(m_encoding);
@@ -99,13 +359,19 @@ ParquetColumn::add_datum(void const * i_ptr,
         }
     }
 
-    check_full(check_size);
+    check_full(check_size, i_replvl);
 
     add_levels(i_replvl, i_deflvl);
     
     if (i_ptr) {
+        m_page_stats->update(i_ptr, i_size);
+        if (m_bloom_filter)
+            m_bloom_filter->insert(BloomFilter::hash(i_ptr, i_size));
+
         switch (m_encoding) {
         case Encoding::PLAIN:
+        case Encoding::DELTA_BINARY_PACKED:
+        case Encoding::BYTE_STREAM_SPLIT:
             if (i_isvarlen) {
                 uint32_t len = i_size;
                 uint8_t * lenptr = (uint8_t *) &len;
@@ -114,7 +380,13 @@ ParquetColumn::add_datum(void const * i_ptr,
             m_data.append(static_cast<char const *>(i_ptr), i_size);
             break;
         case Encoding::PLAIN_DICTIONARY:
-            m_val_enc.Put(enc_val);
+            m_dict_ndxs.push_back(enc_val);
+            break;
+        case Encoding::DELTA_LENGTH_BYTE_ARRAY:
+        case Encoding::DELTA_BYTE_ARRAY:
+            // Lengths are kept apart from the value bytes.
+            m_val_lens.push_back(i_size);
+            m_data.append(static_cast<char const *>(i_ptr), i_size);
             break;
         default:
             cerr << "unsupported encoding: " << int(m_encoding);
@@ -122,6 +394,8 @@ ParquetColumn::add_datum(void const * i_ptr,
             break;
         }
     }
+
+    update_rowgrp_size();
 }
 
 void
@@ -129,10 +403,19 @@ ParquetColumn::add_boolean_datum(bool i_val,
                                  int i_replvl,
                                  int i_deflvl)
 {
-    check_full(1);
+    check_full(m_encoding == Encoding::RLE ? 0 : 1, i_replvl);
 
     add_levels(i_replvl, i_deflvl);
     
+    m_page_stats->update(&i_val, sizeof(i_val));
+
+    if (m_encoding == Encoding::RLE) {
+        need_buffers();
+        m_bool_enc.Put(i_val);
+        update_rowgrp_size();
+        return;
+    }
+
     if (i_val)
         m_bool_buf |= (1 << m_bool_cnt);
     ++m_bool_cnt;
@@ -142,8 +425,198 @@ ParquetColumn::add_boolean_datum(bool i_val,
         m_bool_buf = 0;
         m_bool_cnt = 0;
     }
+
+    update_rowgrp_size();
+}
+
+void
+ParquetColumn::add_boolean_values(bool const * i_vals,
+                                  size_t i_nlvls,
+                                  int16_t const * i_replvls,
+                                  int16_t const * i_deflvls)
+{
+    if (m_data_type != Type::BOOLEAN) {
+        cerr << "add_boolean_values: " << path_string()
+             << " data type " << int(m_data_type) << " isn't BOOLEAN";
+        exit(1);
+    }
+
+    size_t lvlndx = 0;
+    while (lvlndx < i_nlvls) {
+        int16_t const * replvls = i_replvls ? i_replvls + lvlndx : NULL;
+        int16_t const * deflvls = i_deflvls ? i_deflvls + lvlndx : NULL;
+
+        size_t avail = i_nlvls - lvlndx;
+        size_t nlvls = batch_capacity(deflvls, avail, 0);
+        if (nlvls < avail)
+            nlvls = record_aligned(replvls, deflvls, nlvls, avail);
+        nlvls = rows_capacity(replvls, nlvls);
+        if (nlvls == 0) {
+            make_room(replvls ? replvls[0] : 0);
+            continue;
+        }
+
+        size_t nvals = count_values(deflvls, nlvls);
+
+        if (m_encoding == Encoding::RLE) {
+            // Runs collapse inside the encoder as they are Put.
+            if (nvals)
+                need_buffers();
+            m_bool_enc.PutBatch(i_vals, nvals);
+        }
+        else {
+            for (size_t ndx = 0; ndx < nvals; ++ndx) {
+                if (i_vals[ndx])
+                    m_bool_buf |= (1 << m_bool_cnt);
+                if (++m_bool_cnt == 8) {
+                    m_data.append((char const *) &m_bool_buf, 1);
+                    m_bool_buf = 0;
+                    m_bool_cnt = 0;
+                }
+            }
+        }
+
+        m_page_stats->update_batch(i_vals, nvals);
+        add_levels(replvls, deflvls, nlvls);
+        lvlndx += nlvls;
+        i_vals += nvals;
+    }
+
+    update_rowgrp_size();
+}
+
+template<typename T>
+void
+ParquetColumn::add_values(T const * i_vals,
+                          size_t i_nlvls,
+                          int16_t const * i_replvls,
+                          int16_t const * i_deflvls)
+{
+    if (sizeof(T) != fixed_width(m_data_type)) {
+        cerr << "add_values: " << sizeof(T) << " byte values don't match "
+             << path_string() << " data type " << int(m_data_type);
+        exit(1);
+    }
+
+    size_t lvlndx = 0;
+    while (lvlndx < i_nlvls) {
+        int16_t const * replvls = i_replvls ? i_replvls + lvlndx : NULL;
+        int16_t const * deflvls = i_deflvls ? i_deflvls + lvlndx : NULL;
+
+        if (m_encoding == Encoding::PLAIN_DICTIONARY)
+            check_dict(!replvls || replvls[0] == 0);
+
+        // Take as many levels as are guaranteed to fit in this page.
+        size_t avail = i_nlvls - lvlndx;
+        size_t nlvls = batch_capacity(deflvls, avail, sizeof(T));
+        if (nlvls < avail)
+            nlvls = record_aligned(replvls, deflvls, nlvls, avail);
+        nlvls = rows_capacity(replvls, nlvls);
+        if (nlvls == 0) {
+            make_room(replvls ? replvls[0] : 0);
+            continue;
+        }
+
+        size_t nvals = count_values(deflvls, nlvls);
+        bool overflowed = false;
+        bool deferred = false;
+
+        switch (m_encoding) {
+        case Encoding::PLAIN:
+        case Encoding::DELTA_BINARY_PACKED:
+        case Encoding::BYTE_STREAM_SPLIT:
+            m_data.append(reinterpret_cast<char const *>(i_vals),
+                          nvals * sizeof(T));
+            break;
+        case Encoding::PLAIN_DICTIONARY:
+            {
+                typedef typename DictionaryKey<sizeof(T)>::type Key;
+                FixedDictionaryEncoder<Key> & dict_enc =
+                    static_cast<FixedDictionaryEncoder<Key> &>(*m_dict_enc);
+                // The batch capacity allows for every value being new
+                // to the dictionary, so the indices fit; the dictionary
+                // itself may still overflow.
+                size_t nenc = 0;
+                while (nenc < nvals) {
+                    try {
+                        for (; nenc < nvals; ++nenc) {
+                            Key key;
+                            memcpy(&key, &i_vals[nenc], sizeof(key));
+                            m_dict_ndxs.push_back(dict_enc.encode(key));
+                        }
+                    }
+                    catch (overflow_error const & ex) {
+                        // Stop short of the value, unless an aligned
+                        // page can't be cut there; then the rest of
+                        // its record goes past the dictionary's limits.
+                        size_t lvl = levels_for_values(deflvls, nlvls, nenc);
+                        if (defer_fallback(replvls ? replvls[lvl] : 0)) {
+                            size_t end = lvl + 1;
+                            while (end < nlvls && replvls[end] != 0)
+                                ++end;
+                            nlvls = end;
+                            nvals = count_values(deflvls, nlvls);
+                            deferred = true;
+                        }
+                        else {
+                            nlvls = lvl;
+                            nvals = nenc;
+                            overflowed = true;
+                        }
+                    }
+                }
+                m_dict_num_values += nenc;
+                m_dict_plain_size += nenc * sizeof(T);
+                if (deferred)
+                    fit_levels(nlvls);
+            }
+            break;
+        default:
+            cerr << "unsupported encoding: " << int(m_encoding);
+            exit(1);
+            break;
+        }
+
+        m_page_stats->update_batch(i_vals, nvals);
+        if (m_bloom_filter) {
+            m_bloom_hashes.resize(nvals);
+            for (size_t ndx = 0; ndx < nvals; ++ndx)
+                m_bloom_hashes[ndx] =
+                    BloomFilter::hash(&i_vals[ndx], sizeof(T));
+            m_bloom_filter->insert(m_bloom_hashes.data(), nvals);
+        }
+        add_levels(replvls, deflvls, nlvls);
+        lvlndx += nlvls;
+        i_vals += nvals;
+
+        if (overflowed) {
+            // We've overflowed the dictionary, fallback to PLAIN.
+            fallback_to_plain();
+        }
+    }
+
+    update_rowgrp_size();
 }
 
+template void ParquetColumn::add_values<int32_t>(int32_t const *, size_t,
+                                                 int16_t const *,
+                                                 int16_t const *);
+template void ParquetColumn::add_values<uint32_t>(uint32_t const *, size_t,
+                                                  int16_t const *,
+                                                  int16_t const *);
+template void ParquetColumn::add_values<int64_t>(int64_t const *, size_t,
+                                                 int16_t const *,
+                                                 int16_t const *);
+template void ParquetColumn::add_values<uint64_t>(uint64_t const *, size_t,
+                                                  int16_t const *,
+                                                  int16_t const *);
+template void ParquetColumn::add_values<float>(float const *, size_t,
+                                               int16_t const *,
+                                               int16_t const *);
+template void ParquetColumn::add_values<double>(double const *, size_t,
+                                                int16_t const *,
+                                                int16_t const *);
+
 string
 ParquetColumn::name() const
 {
@@ -210,16 +683,61 @@ ParquetColumn::rowgrp_size() const
 size_t
 ParquetColumn::estimated_rowgrp_size() const
 {
-    // Provide a very rough estimate of the size of this rowgroup.
-    // Presumes a compression ratio of 3 on the dictionary.  The
-    // compressed page data size is in m_compressed_size.  Add some
-    // per-page hesader overhead as well.
+    // Pages already compressed count at their size, everything else,
+    // the page in progress and the dictionary included, at the
+    // compression ratio seen so far.  Add some per-page header
+    // overhead as well.
+    size_t ndx_bits = m_dict_ndxs.empty() ? 0 :
+        impala::BitUtil::Log2(max(m_dict_enc->m_nvals, size_t(1)));
+    size_t raw_size =
+        m_dict_enc->data_size() +
+        m_pending_size +
+        m_data.size() +
+        m_dict_ndxs.size() * ndx_bits / 8;
     return
-        m_dict_enc.m_data.size() / 3 + 100 +
+        size_t(raw_size * m_compression_ratio) + 100 +
         m_pages.size() * 100 +
         m_compressed_size;
 }
 
+void
+ParquetColumn::track_rowgrp_size(size_t * io_total)
+{
+    if (m_rowgrp_total)
+        *m_rowgrp_total -= m_estimated_size;
+    m_rowgrp_total = io_total;
+    m_estimated_size = estimated_rowgrp_size();
+    if (m_rowgrp_total)
+        *m_rowgrp_total += m_estimated_size;
+}
+
+size_t
+ParquetColumn::memory_usage() const
+{
+    size_t usage =
+        sizeof(*this) +
+        (m_rep_buf ? m_buf_size : 0) +
+        (m_def_buf ? m_buf_size : 0) +
+        (m_val_buf ? m_buf_size : 0) +
+        m_data.capacity() +
+        m_enc_data.capacity() +
+        m_concat_buffer.capacity() +
+        m_dict_ndxs.capacity() * sizeof(uint32_t) +
+        m_val_lens.capacity() * sizeof(int32_t) +
+        m_dict_enc->memory_usage() +
+        m_held_page_size +
+        m_pending_size;
+    if (m_bloom_filter)
+        usage += m_bloom_filter->num_bytes();
+    return usage;
+}
+
+size_t
+ParquetColumn::fixed_memory_usage() const
+{
+    return m_bloom_filter ? m_bloom_filter->num_bytes() : 0;
+}
+
 void
 ParquetColumn::traverse(Traverser & tt)
 {
@@ -229,49 +747,54 @@ ParquetColumn::traverse(Traverser & tt)
     }
 }
 
-ColumnMetaData
-ParquetColumn::write_row_group(int fd, TCompactProtocol * protocol)
+ChunkBufferHandle
+ParquetColumn::detach_row_group()
 {
     // Finialize any remaining data.
     if (m_num_page_values)
         finalize_page();
+    if (!m_codec_chosen)
+        choose_codec();
+    gather_pages(true);
+
+    ChunkBufferHandle chunk = make_shared<ChunkBuffer>();
 
-    m_column_write_offset = lseek(fd, 0, SEEK_CUR);
+    // Page headers are serialized up front so the chunk size is
+    // known before anything is written.
+    boost::shared_ptr<TMemoryBuffer> header_buffer(new TMemoryBuffer());
+    TCompactProtocol protocol(header_buffer);
 
     if (m_original_encoding == Encoding::PLAIN_DICTIONARY) {
-        size_t dictsz = m_dict_enc.m_data.size();
+        size_t dictsz = m_dict_enc->data_size();
 
-        m_concat_buffer.assign(m_dict_enc.m_data.begin(),
-                               m_dict_enc.m_data.end());
+        m_concat_buffer.assign(m_dict_enc->data(), dictsz);
         string out;
-        m_compressor.compress(m_concat_buffer, out);
+        Compressor::thread_compressor(m_compression_codec,
+                                      m_compression_level)
+            .compress(m_concat_buffer, out);
         
         DictionaryPageHeader dph;
-        dph.__set_num_values(m_dict_enc.m_nvals);
-        dph.__set_encoding(Encoding::PLAIN_DICTIONARY);
+        dph.__set_num_values(m_dict_enc->m_nvals);
+        // PLAIN_DICTIONARY is deprecated alongside DATA_PAGE_V2.
+        dph.__set_encoding(m_data_page_v2
+                           ? Encoding::PLAIN
+                           : Encoding::PLAIN_DICTIONARY);
 
         PageHeader ph;
         ph.__set_type(PageType::DICTIONARY_PAGE);
         ph.__set_uncompressed_page_size(dictsz);
         ph.__set_compressed_page_size(out.size());
         ph.__set_dictionary_page_header(dph);
+        if (m_page_checksum)
+            ph.__set_crc(crc32_checksum(out.data(), out.size()));
 
-        size_t header_size = ph.write(protocol);
-        m_uncompressed_size += header_size;
-        m_compressed_size += header_size;
+        ph.write(&protocol);
+        chunk->m_dict_page = header_buffer->getBufferAsString();
+        size_t header_size = chunk->m_dict_page.size();
+        chunk->m_dict_page.append(out);
 
-        ssize_t rv = write(fd, out.data(), out.size());
-        if (rv < 0) {
-            cerr << "write dict failed: " << strerror(errno);
-            exit(1);
-        }
-        else if (rv != out.size()) {
-            cerr << "write: unexpected size:"
-                 << " expecting " << out.size() << ", saw " << rv;
-            exit(1);
-        }
-        m_uncompressed_size += dictsz;
-        m_compressed_size += out.size();
+        m_uncompressed_size += header_size + dictsz;
+        m_compressed_size += header_size + out.size();
 
 #if defined(DEBUG)        
         cerr << path_string()
@@ -279,19 +802,15 @@ ParquetColumn::write_row_group(int fd, TCompactProtocol * protocol)
              << " data_size " + dictsz;
 #endif
     }
-    
-    size_t pgndx = 0;
+
     for (DataPageHandle dph : m_pages) {
-        // The m_uncompressed_page_size and m_compressed_size
-        // were updated during in finalize_page ...
-        size_t header_size = dph->write_page(fd, protocol);
-#if defined(DEBUG)        
-        cerr << path_string()
-             << " pg " << pgndx << " header_size " << header_size;
-#endif
-        m_uncompressed_size += header_size;
-        m_compressed_size += header_size;
-        ++pgndx;
+        // The page sizes themselves were counted as they finished.
+        header_buffer->resetBuffer();
+        dph->m_page_header.write(&protocol);
+        dph->m_header = header_buffer->getBufferAsString();
+        m_uncompressed_size += dph->m_header.size();
+        m_compressed_size += dph->m_header.size();
+        m_held_page_size += dph->m_header.size();
     }
 
     // We don't want the top-level name in the path here.
@@ -302,21 +821,121 @@ ParquetColumn::write_row_group(int fd, TCompactProtocol * protocol)
          << " total_uncompressed_size " << m_uncompressed_size;
 #endif
 
-    ColumnMetaData column_metadata;
+    ColumnMetaData & column_metadata = chunk->m_metadata;
     column_metadata.__set_type(m_data_type);
-    column_metadata.__set_encodings(m_encodings);
+    // Under DATA_PAGE_V2 the dictionary is PLAIN and the indices are
+    // RLE_DICTIONARY.
+    vector<Encoding::type> encodings = m_encodings;
+    if (m_data_page_v2 &&
+        m_original_encoding == Encoding::PLAIN_DICTIONARY) {
+        replace(encodings.begin(), encodings.end(),
+                Encoding::PLAIN_DICTIONARY, Encoding::RLE_DICTIONARY);
+        if (find(encodings.begin(), encodings.end(), Encoding::PLAIN) ==
+            encodings.end())
+            encodings.push_back(Encoding::PLAIN);
+    }
+    column_metadata.__set_encodings(encodings);
     column_metadata.__set_codec(m_compression_codec);
     column_metadata.__set_num_values(m_num_rowgrp_values);
     column_metadata.__set_total_uncompressed_size(m_uncompressed_size);
     column_metadata.__set_total_compressed_size(m_compressed_size);
-    column_metadata.__set_data_page_offset(m_column_write_offset);
     column_metadata.__set_path_in_schema(topless);
 
+    Statistics chunk_stats;
+    chunk_stats.__set_null_count(m_num_rowgrp_nulls);
+    // The dictionary holds each distinct value once, unless some were
+    // written PLAIN after a fallback.
+    if (m_encodings.size() == 1 &&
+        m_original_encoding == Encoding::PLAIN_DICTIONARY)
+        chunk_stats.__set_distinct_count(m_dict_enc->m_nvals);
+    m_chunk_stats->get(chunk_stats);
+    column_metadata.__set_statistics(chunk_stats);
+
+    // The chunk takes the pages, statistics and Bloom filter along,
+    // the column starts afresh.
+    chunk->m_pages.swap(m_pages);
+    chunk->m_spill_file = m_spill_file;
+    chunk->m_memory_usage = chunk->m_dict_page.size() + m_held_page_size;
+    chunk->m_stats = m_chunk_stats;
+    m_chunk_stats = ColumnStatistics::create(m_data_type, m_converted_type);
+    chunk->m_collect_index = m_page_index;
+    chunk->m_bloom_filter = m_bloom_filter;
+
     reset_row_group_state();
+    update_rowgrp_size();
+    
+    return chunk;
+}
+
+size_t
+ChunkBuffer::size() const
+{
+    return m_metadata.total_compressed_size;
+}
+
+size_t
+ChunkBuffer::memory_usage() const
+{
+    return m_memory_usage;
+}
+
+ColumnMetaData
+ChunkBuffer::write(int fd, off_t i_offset)
+{
+    off_t page_offset = i_offset;
+    if (!m_dict_page.empty()) {
+        write_at(fd, m_dict_page, page_offset);
+        page_offset += m_dict_page.size();
+    }
     
+    if (m_collect_index)
+        m_page_index = make_shared<PageIndex>();
+
+    string spilled;
+    for (DataPageHandle dph : m_pages) {
+        size_t header_size = dph->m_header.size();
+        size_t data_size = dph->m_page_header.compressed_page_size;
+        write_at(fd, dph->m_header, page_offset);
+        if (dph->m_spill_offset >= 0) {
+            m_spill_file->read(dph->m_spill_offset, data_size, spilled);
+            m_spill_file->discard(dph->m_spill_offset, data_size);
+            write_at(fd, spilled, page_offset + header_size);
+        }
+        else {
+            write_at(fd, dph->m_page_data, page_offset + header_size);
+        }
+        if (m_page_index)
+            index_page(*m_page_index, *dph, page_offset, header_size);
+        page_offset += header_size + data_size;
+    }
+
+    if (m_page_index && m_page_index->m_has_column_index) {
+        ColumnIndex & column_index = m_page_index->m_column_index;
+        column_index.__set_boundary_order(boundary_order(column_index));
+        column_index.__isset.null_counts = true;
+    }
+
+    m_pages.clear();
+    m_spill_file.reset();
+    string().swap(m_dict_page);
+
+    ColumnMetaData column_metadata = m_metadata;
+    column_metadata.__set_data_page_offset(i_offset);
     return column_metadata;
 }
 
+PageIndexHandle const &
+ChunkBuffer::page_index() const
+{
+    return m_page_index;
+}
+
+BloomFilterHandle const &
+ChunkBuffer::bloom_filter() const
+{
+    return m_bloom_filter;
+}
+
 SchemaElement
 ParquetColumn::schema_element() const
 {
@@ -335,67 +954,288 @@ ParquetColumn::schema_element() const
     return move(elem);
 }
 
-size_t
-ParquetColumn::DataPage::write_page(int fd, TCompactProtocol * protocol)
+void
+ChunkBuffer::index_page(PageIndex & io_index,
+                        DataPage const & i_page,
+                        off_t i_offset,
+                        size_t i_header_size) const
 {
-    size_t header_size = m_page_header.write(protocol);
-    ssize_t rv = write(fd, m_page_data.data(), m_page_data.size());
-    if (rv < 0) {
-        cerr << "DataPage write failed: " << strerror(errno);
-        exit(1);
+    PageLocation location;
+    location.__set_offset(i_offset);
+    location.__set_compressed_page_size(
+        i_header_size + i_page.m_page_header.compressed_page_size);
+    location.__set_first_row_index(i_page.m_first_row);
+    io_index.m_offset_index.page_locations.push_back(location);
+
+    PageHeader const & header = i_page.m_page_header;
+    Statistics const & stats =
+        header.type == PageType::DATA_PAGE_V2
+        ? header.data_page_header_v2.statistics
+        : header.data_page_header.statistics;
+    int32_t num_values =
+        header.type == PageType::DATA_PAGE_V2
+        ? header.data_page_header_v2.num_values
+        : header.data_page_header.num_values;
+
+    // There's no column index if a page with values has no bounds,
+    // as when they are all NaN.
+    if (!io_index.m_has_column_index)
+        return;
+    ColumnIndex & column_index = io_index.m_column_index;
+    bool null_page = stats.null_count == num_values;
+    if (!null_page && !stats.__isset.min_value) {
+        io_index.m_has_column_index = false;
+        column_index = ColumnIndex();
+        return;
     }
-    else if (rv != m_page_data.size()) {
-        cerr << "DataPage write: unexpected size:"
-             << " expecting " << m_page_data.size() << ", saw " << rv;
-        exit(1);
+
+    column_index.null_pages.push_back(null_page);
+    column_index.min_values.push_back(stats.min_value);
+    column_index.max_values.push_back(stats.max_value);
+    column_index.null_counts.push_back(stats.null_count);
+}
+
+BoundaryOrder::type
+ChunkBuffer::boundary_order(ColumnIndex const & i_index) const
+{
+    // Pages are ascending (descending) when each page's bounds are
+    // no less (no greater) than those of the page before it.
+    bool ascending = true;
+    bool descending = true;
+    int prev = -1;
+    for (size_t ndx = 0; ndx < i_index.null_pages.size(); ++ndx) {
+        if (i_index.null_pages[ndx])
+            continue;
+        if (prev >= 0) {
+            int mincmp = m_stats->compare(i_index.min_values[prev],
+                                          i_index.min_values[ndx]);
+            int maxcmp = m_stats->compare(i_index.max_values[prev],
+                                          i_index.max_values[ndx]);
+            if (mincmp > 0 || maxcmp > 0)
+                ascending = false;
+            if (mincmp < 0 || maxcmp < 0)
+                descending = false;
+        }
+        prev = ndx;
     }
-    return header_size;
+
+    if (ascending)
+        return BoundaryOrder::ASCENDING;
+    else if (descending)
+        return BoundaryOrder::DESCENDING;
+    return BoundaryOrder::UNORDERED;
+}
+
+void
+DataPage::compress(Compressor & io_compressor)
+{
+    string out;
+    if (m_page_header.type == PageType::DATA_PAGE_V2) {
+        // Only the values are compressed, and only kept that way when
+        // it spares readers inflating incompressible values.
+        string values(m_page_data, m_levels_size);
+        io_compressor.compress(values, out);
+        if (out.size() < m_page_data.size() - m_levels_size) {
+            m_page_data.resize(m_levels_size);
+            m_page_data.append(out);
+            m_page_header.data_page_header_v2.__set_is_compressed(true);
+        }
+    }
+    else {
+        io_compressor.compress(m_page_data, out);
+        m_page_data.swap(out);
+    }
+    m_page_header.__set_compressed_page_size(m_page_data.size());
+}
+
+void
+DataPage::checksum()
+{
+    m_page_header.__set_crc(crc32_checksum(m_page_data.data(),
+                                           m_page_data.size()));
 }
 
 void
 ParquetColumn::add_levels(int i_replvl, int i_deflvl)
 {
-    if (m_maxreplvl > 0)
-        m_rep_enc.Put(i_replvl);
+    open_page(i_replvl);
 
-    if (m_maxdeflvl > 0)
-        m_def_enc.Put(i_deflvl);
+    // Repeats of a null are only counted until there are buffers.
+    if (!m_has_buffers &&
+        i_deflvl < m_maxdeflvl &&
+        (m_null_run == 0 ||
+         (i_replvl == m_null_run_replvl && i_deflvl == m_null_run_deflvl))) {
+        m_null_run_replvl = i_replvl;
+        m_null_run_deflvl = i_deflvl;
+        ++m_null_run;
+    }
+    else {
+        need_buffers();
+        if (m_maxreplvl > 0)
+            m_rep_enc.Put(i_replvl);
+        if (m_maxdeflvl > 0)
+            m_def_enc.Put(i_deflvl);
+    }
 
     ++m_num_page_values;
 
-    if (i_replvl == 0)
+    if (i_deflvl < m_maxdeflvl)
+        ++m_num_page_nulls;
+
+    if (i_replvl == 0) {
+        ++m_num_page_recs;
         ++m_num_rowgrp_recs;
+    }
 }
 
 void
-ParquetColumn::finalize_page()
+ParquetColumn::add_levels(int16_t const * i_replvls,
+                          int16_t const * i_deflvls,
+                          size_t i_nlvls)
 {
-#if defined(DEBUG)
-    size_t pgndx = m_pages.size();
-#endif
+    if (i_nlvls == 0)
+        return;
 
-    DataPageHandle dph = make_shared<DataPage>();
+    open_page(i_replvls ? i_replvls[0] : 0);
 
-    m_rep_enc.Flush();
-    m_def_enc.Flush();
-    m_val_enc.Flush();
+    size_t nvals = count_values(i_deflvls, i_nlvls);
+    size_t nrecs = i_nlvls;
+    if (i_replvls)
+        nrecs = count(i_replvls, i_replvls + i_nlvls, 0);
+    m_num_page_values += i_nlvls;
+    m_num_page_nulls += i_nlvls - nvals;
+    m_num_page_recs += nrecs;
+    m_num_rowgrp_recs += nrecs;
 
-    if (m_bool_cnt) {
-        m_data.append((char const *) &m_bool_buf, 1);
-        m_bool_buf = 0;
-        m_bool_cnt = 0;
+    if (!m_has_buffers && nvals == 0) {
+        // Repeats of a null are only counted until there are buffers.
+        int replvl = i_replvls ? i_replvls[0] : 0;
+        int deflvl = i_deflvls[0];
+        bool repeats = m_null_run == 0 ||
+            (replvl == m_null_run_replvl && deflvl == m_null_run_deflvl);
+        repeats = repeats &&
+            size_t(count(i_deflvls, i_deflvls + i_nlvls, deflvl)) == i_nlvls;
+        if (repeats && i_replvls)
+            repeats =
+                size_t(count(i_replvls, i_replvls + i_nlvls, replvl)) == i_nlvls;
+        if (repeats) {
+            m_null_run_replvl = replvl;
+            m_null_run_deflvl = deflvl;
+            m_null_run += i_nlvls;
+            return;
+        }
+    }
+    need_buffers();
+
+    if (m_maxreplvl > 0) {
+        if (i_replvls) {
+            m_rep_enc.PutBatch(i_replvls, i_nlvls);
+        }
+        else {
+            for (size_t ndx = 0; ndx < i_nlvls; ++ndx)
+                m_rep_enc.Put(0);
+        }
+    }
+
+    if (m_maxdeflvl > 0) {
+        if (i_deflvls) {
+            m_def_enc.PutBatch(i_deflvls, i_nlvls);
+        }
+        else {
+            for (size_t ndx = 0; ndx < i_nlvls; ++ndx)
+                m_def_enc.Put(m_maxdeflvl);
+        }
+    }
+}
+
+size_t
+ParquetColumn::count_values(int16_t const * i_deflvls, size_t i_nlvls) const
+{
+    if (!i_deflvls)
+        return i_nlvls;
+    return count(i_deflvls, i_deflvls + i_nlvls, m_maxdeflvl);
+}
+
+size_t
+ParquetColumn::levels_for_values(int16_t const * i_deflvls,
+                                 size_t i_nlvls,
+                                 size_t i_nvals) const
+{
+    // How many levels precede the (i_nvals + 1)th defined value?
+    if (!i_deflvls)
+        return min(i_nvals, i_nlvls);
+    size_t nvals = 0;
+    size_t ndx = 0;
+    for (; ndx < i_nlvls; ++ndx) {
+        if (i_deflvls[ndx] == m_maxdeflvl && nvals++ == i_nvals)
+            break;
+    }
+    return ndx;
+}
+
+size_t
+ParquetColumn::buffer_capacity(int16_t const * i_deflvls,
+                               size_t i_nlvls,
+                               size_t i_reserve)
+{
+    // How many of the next i_nlvls levels fit the level, RLE boolean
+    // and index buffers, leaving i_reserve bytes of each spare?
+    size_t bufsz = m_buf_size - i_reserve;
+    size_t capacity = i_nlvls;
+
+    if (m_maxreplvl > 0)
+        capacity = min(capacity,
+                       rle_capacity(m_rep_enc, bufsz,
+                                    impala::BitUtil::Log2(m_maxreplvl + 1)));
+    if (m_maxdeflvl > 0)
+        capacity = min(capacity,
+                       rle_capacity(m_def_enc, bufsz,
+                                    impala::BitUtil::Log2(m_maxdeflvl + 1)));
+
+    if (m_data_type == Type::BOOLEAN && m_encoding == Encoding::RLE)
+        capacity = min(capacity, rle_capacity(m_bool_enc, bufsz, 1));
+    else if (m_encoding == Encoding::PLAIN_DICTIONARY)
+        capacity = levels_for_values(i_deflvls, capacity,
+                                     dict_capacity(i_reserve, 0));
+    return capacity;
+}
+
+size_t
+ParquetColumn::batch_capacity(int16_t const * i_deflvls,
+                              size_t i_nlvls,
+                              size_t i_valsz)
+{
+    // How many of the next i_nlvls levels can be added to this page
+    // without checking for a full page after each one?  Aligned pages
+    // keep an eighth of the buffers to finish their last record.
+    size_t reserve = aligns_records() ? m_buf_size / 8 : 0;
+    size_t capacity = buffer_capacity(i_deflvls, i_nlvls, reserve);
+    size_t used = page_data_size();
+    size_t room = used < m_page_bytes ? m_page_bytes - used : 0;
+
+    if (m_data_type == Type::BOOLEAN) {
+        if (m_encoding == Encoding::RLE)
+            // The page target bounds the encoded booleans much as the
+            // buffer does.
+            capacity = min(capacity, rle_capacity(m_bool_enc, m_page_bytes, 1));
+        else
+            // PLAIN packs eight values to the byte, the partial byte
+            // still in m_bool_buf included.
+            capacity = levels_for_values(i_deflvls, capacity,
+                                         room * 8 > size_t(m_bool_cnt)
+                                         ? room * 8 - m_bool_cnt : 0);
+        return capacity;
     }
 
-    size_t uncompressed_page_size;
     switch (m_encoding) {
     case Encoding::PLAIN:
-        uncompressed_page_size =
-            m_rep_enc.len() + m_def_enc.len() + m_data.size();
+    case Encoding::DELTA_BINARY_PACKED:
+    case Encoding::BYTE_STREAM_SPLIT:
+        capacity = levels_for_values(i_deflvls, capacity, room / i_valsz);
         break;
     case Encoding::PLAIN_DICTIONARY:
-        uncompressed_page_size =
-            // RLE(replvl) + RLE(deflvl) + bitwidth + RLE(encoded-values)
-            m_rep_enc.len() + m_def_enc.len() + 1 + m_val_enc.len();
+        capacity = levels_for_values(i_deflvls, capacity,
+                                     dict_capacity(reserve, m_page_bytes));
         break;
     default:
         cerr << "unsupported encoding: " << int(m_encoding);
@@ -403,40 +1243,321 @@ ParquetColumn::finalize_page()
         break;
     }
 
-    if (m_rep_enc.len())
-        uncompressed_page_size += 4;
-    if (m_def_enc.len())
-        uncompressed_page_size += 4;
+    return capacity;
+}
+
+size_t
+ParquetColumn::record_aligned(int16_t const * i_replvls,
+                              int16_t const * i_deflvls,
+                              size_t i_nlvls,
+                              size_t i_avail)
+{
+    // An aligned page which is about to fill ends before the record
+    // in progress at i_nlvls.  If the page holds nothing before that
+    // record, or it began in an earlier batch, the page takes the
+    // rest of it instead, as far as the buffers allow.
+    if (!aligns_records() || !i_replvls)
+        return i_nlvls;
+
+    size_t nlvls = i_nlvls;
+    while (nlvls > 0 && i_replvls[nlvls] != 0)
+        --nlvls;
+    if (nlvls > 0 || (i_replvls[0] == 0 && m_num_page_values > 0))
+        return nlvls;
+
+    size_t limit = buffer_capacity(i_deflvls, i_avail, 0);
+    nlvls = max(i_nlvls, size_t(1));
+    while (nlvls < limit && i_replvls[nlvls] != 0)
+        ++nlvls;
+    return min(nlvls, limit);
+}
+
+size_t
+ParquetColumn::rows_capacity(int16_t const * i_replvls, size_t i_nlvls) const
+{
+    // How many levels can be added without going over the page's row
+    // limit?  The page ends ahead of the first record beyond it.
+    size_t max_rows = m_page_policy.m_max_rows;
+    if (!max_rows)
+        return i_nlvls;
+    size_t room = m_num_page_recs < max_rows ? max_rows - m_num_page_recs : 0;
+    if (!i_replvls)
+        return min(i_nlvls, room);
+
+    size_t ndx = 0;
+    for (; ndx < i_nlvls; ++ndx) {
+        if (i_replvls[ndx] == 0 && room-- == 0)
+            break;
+    }
+    return ndx;
+}
+
+void
+ParquetColumn::check_dict(bool i_record_start)
+{
+    // Falling back cuts the page, so aligned pages only do it at the
+    // start of a record: a little ahead of the dictionary's limits,
+    // or once the record which went past them is done.
+    if (aligns_records()) {
+        if (!i_record_start)
+            return;
+        size_t max_bytes = m_dict_policy.m_max_bytes;
+        size_t max_nvals = DictionaryEncoder::MAX_NVALS;
+        if (m_fallback_pending ||
+            m_dict_enc->data_size() >= max_bytes - max_bytes / 8 ||
+            m_dict_enc->m_nvals >= max_nvals - max_nvals / 8) {
+            fallback_to_plain();
+            return;
+        }
+    }
+
+    if (m_dict_num_values >= m_dict_next_check)
+        check_dict_benefit();
+}
+
+void
+ParquetColumn::check_dict_benefit()
+{
+    m_dict_next_check = m_dict_num_values + m_dict_policy.m_check_interval;
+
+    // Mostly distinct values gain nothing from the dictionary.
+    size_t nvals = m_dict_enc->m_nvals;
+    if (nvals > m_dict_num_values * m_dict_policy.m_max_distinct_ratio) {
+        fallback_to_plain();
+        return;
+    }
+
+    // Nor is it worth it if the dictionary plus the indices aren't
+    // smaller than the values would have been.
+    int bitwidth = impala::BitUtil::Log2(max(nvals, size_t(1)));
+    size_t encoded_size =
+        m_dict_enc->data_size() + (m_dict_num_values * bitwidth + 7) / 8;
+    if (encoded_size >= m_dict_plain_size)
+        fallback_to_plain();
+}
+
+bool
+ParquetColumn::defer_fallback(int i_replvl)
+{
+    // An aligned page can't be cut part way through a record, so the
+    // dictionary takes the rest of it and check_dict falls back at
+    // the next record start.
+    if (!aligns_records() || i_replvl == 0)
+        return false;
+    m_fallback_pending = true;
+    m_dict_enc->allow_overflow(true);
+    return true;
+}
+
+void
+ParquetColumn::fallback_to_plain()
+{
+    if (m_encoding != Encoding::PLAIN_DICTIONARY)
+        return;
+
+    m_fallback_pending = false;
+    m_dict_enc->allow_overflow(false);
+
+    // Pages already dictionary encoded stay that way, the rest of
+    // the column chunk is PLAIN.
+    if (m_num_page_values)
+        finalize_page();
+    m_encoding = Encoding::PLAIN;
+    m_encodings.push_back(Encoding::PLAIN);
+}
+
+size_t
+ParquetColumn::dict_page_capacity(size_t i_nvals,
+                                  size_t i_reserve,
+                                  size_t i_target) const
+{
+    // How many dictionary indices are guaranteed to RLE encode into
+    // m_val_buf, less i_reserve bytes, once the dictionary holds
+    // i_nvals entries?  A non-zero i_target also caps them at about
+    // that many bytes bit packed.
+    int bitwidth = impala::BitUtil::Log2(max(i_nvals, size_t(1)));
+    size_t used = 2 * impala::RleEncoder::MinBufferSize(bitwidth) + i_reserve;
+    size_t capacity =
+        used < m_buf_size ? (m_buf_size - used) * 8 / (bitwidth + 2) : 0;
+    if (i_target && bitwidth)
+        capacity = min(capacity, i_target * 8 / bitwidth);
+    return capacity;
+}
+
+size_t
+ParquetColumn::dict_capacity(size_t i_reserve, size_t i_target) const
+{
+    // How many more values are sure to fit the page, even if each
+    // one is new to the dictionary and widens the indices?  The most
+    // n with size + n <= dict_page_capacity(nvals + n).
+    size_t nvals = m_dict_enc->m_nvals;
+    size_t nndxs = m_dict_ndxs.size();
+    size_t lo = 0;
+    size_t hi = dict_page_capacity(nvals, i_reserve, i_target);
+    hi = hi > nndxs ? hi - nndxs : 0;
+    while (lo < hi) {
+        size_t mid = hi - (hi - lo) / 2;
+        if (nndxs + mid <=
+            dict_page_capacity(nvals + mid, i_reserve, i_target))
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+void
+ParquetColumn::encode_dict_ndxs()
+{
+    // Use the narrowest bit width which can index the dictionary as
+    // it stands now; a single entry dictionary needs no bits at all.
+    m_val_bitwidth =
+        impala::BitUtil::Log2(max(m_dict_enc->m_nvals, size_t(1)));
+
+    impala::RleEncoder val_enc(m_val_buf, m_buf_size, m_val_bitwidth);
+    val_enc.PutBatch(m_dict_ndxs.data(), m_dict_ndxs.size());
+    m_val_len = val_enc.Flush();
+}
+
+void
+ParquetColumn::encode_values()
+{
+    // Values are accumulated in m_data and encoded a page at a time.
+    switch (m_encoding) {
+    case Encoding::DELTA_BINARY_PACKED:
+        if (m_data_type == Type::INT32)
+            m_delta_enc.encode(
+                reinterpret_cast<int32_t const *>(m_data.data()),
+                m_data.size() / sizeof(int32_t), m_enc_data);
+        else
+            m_delta_enc.encode(
+                reinterpret_cast<int64_t const *>(m_data.data()),
+                m_data.size() / sizeof(int64_t), m_enc_data);
+        break;
+    case Encoding::DELTA_LENGTH_BYTE_ARRAY:
+        m_delta_ba_enc.encode_lengths(m_val_lens.data(), m_val_lens.size(),
+                                      m_data.data(), m_enc_data);
+        break;
+    case Encoding::DELTA_BYTE_ARRAY:
+        m_delta_ba_enc.encode_prefixes(m_val_lens.data(), m_val_lens.size(),
+                                       m_data.data(), m_enc_data);
+        break;
+    case Encoding::BYTE_STREAM_SPLIT:
+        byte_stream_split(m_data.data(),
+                          m_data.size() / fixed_width(m_data_type),
+                          fixed_width(m_data_type), m_enc_data);
+        break;
+    default:
+        cerr << "unsupported encoding: " << int(m_encoding);
+        exit(1);
+        break;
+    }
+}
+
+void
+ParquetColumn::finalize_page()
+{
+#if defined(DEBUG)
+    size_t pgndx = m_pages.size();
+#endif
+
+    DataPageHandle dph = make_shared<DataPage>();
+
+    if (m_has_buffers) {
+        if (m_rep_buf)
+            m_rep_enc.Flush();
+        if (m_def_buf)
+            m_def_enc.Flush();
+    }
+    else {
+        encode_null_run();
+    }
+    if (m_encoding == Encoding::PLAIN_DICTIONARY)
+        encode_dict_ndxs();
+    else if (m_encoding == Encoding::DELTA_BINARY_PACKED ||
+             m_encoding == Encoding::BYTE_STREAM_SPLIT ||
+             m_encoding == Encoding::DELTA_LENGTH_BYTE_ARRAY ||
+             m_encoding == Encoding::DELTA_BYTE_ARRAY)
+        encode_values();
+
+    if (m_encoding == Encoding::RLE && m_val_buf)
+        m_bool_enc.Flush();
+
+    if (m_bool_cnt) {
+        m_data.append((char const *) &m_bool_buf, 1);
+        m_bool_buf = 0;
+        m_bool_cnt = 0;
+    }
+
+    size_t uncompressed_page_size;
+    string & out = dph->m_page_data;
+    uint8_t const * rep_levels;
+    uint8_t const * def_levels;
+    size_t rep_len;
+    size_t def_len;
+    page_levels(rep_levels, rep_len, def_levels, def_len);
 
 #if defined(DEBUG)
     cerr << path_string()
          << " pg " << pgndx
          << " m_data.size() " << m_data.size()
-         << " m_rep_enc.len() " << m_rep_enc.len()
-         << " m_def_enc.len() " << m_def_enc.len();
+         << " rep_len " << rep_len
+         << " def_len " << def_len;
 #endif
 
-    string & out = dph->m_page_data;
-    
-    m_concat_buffer.reserve(uncompressed_page_size);
-    concatenate_page_data(m_concat_buffer);
-    m_compressor.compress(m_concat_buffer, out);
-    size_t compressed_page_size = out.size();
-
-    DataPageHeader data_header;
-    data_header.__set_num_values(m_num_page_values);
-    data_header.__set_encoding(m_encoding);
-    // NB: For some reason, the following two must be set, even though
-    // they can default to PLAIN, even for required/nonrepeating fields.
-    // I'm not sure if it's part of the Parquet spec or a bug in
-    // parquet-dump.
-    data_header.__set_definition_level_encoding(Encoding::RLE);
-    data_header.__set_repetition_level_encoding(Encoding::RLE);
-
-    dph->m_page_header.__set_type(PageType::DATA_PAGE);
+    Statistics page_stats;
+    page_stats.__set_null_count(m_num_page_nulls);
+    m_page_stats->get(page_stats);
+    m_chunk_stats->merge(*m_page_stats);
+    m_num_rowgrp_nulls += m_num_page_nulls;
+
+    if (m_data_page_v2) {
+        // The levels go ahead of the values, and stay uncompressed.
+        string & values = page_values();
+        out.reserve(rep_len + def_len + values.size());
+        out.assign((char const *) rep_levels, rep_len);
+        out.append((char const *) def_levels, def_len);
+        dph->m_levels_size = out.size();
+        out.append(values);
+        uncompressed_page_size = out.size();
+
+        DataPageHeaderV2 data_header;
+        data_header.__set_num_values(m_num_page_values);
+        data_header.__set_num_nulls(m_num_page_nulls);
+        data_header.__set_num_rows(m_num_page_recs);
+        data_header.__set_encoding(m_encoding == Encoding::PLAIN_DICTIONARY
+                                   ? Encoding::RLE_DICTIONARY
+                                   : m_encoding);
+        data_header.__set_definition_levels_byte_length(def_len);
+        data_header.__set_repetition_levels_byte_length(rep_len);
+        data_header.__set_is_compressed(false);
+        data_header.__set_statistics(page_stats);
+
+        dph->m_page_header.__set_type(PageType::DATA_PAGE_V2);
+        dph->m_page_header.__set_data_page_header_v2(data_header);
+    }
+    else {
+        concatenate_page_data(out);
+        dph->m_levels_size = 0;
+        uncompressed_page_size = out.size();
+
+        DataPageHeader data_header;
+        data_header.__set_num_values(m_num_page_values);
+        data_header.__set_encoding(m_encoding);
+        // NB: For some reason, the following two must be set, even though
+        // they can default to PLAIN, even for required/nonrepeating fields.
+        // I'm not sure if it's part of the Parquet spec or a bug in
+        // parquet-dump.
+        data_header.__set_definition_level_encoding(Encoding::RLE);
+        data_header.__set_repetition_level_encoding(Encoding::RLE);
+        data_header.__set_statistics(page_stats);
+
+        dph->m_page_header.__set_type(PageType::DATA_PAGE);
+        dph->m_page_header.__set_data_page_header(data_header);
+    }
+
     dph->m_page_header.__set_uncompressed_page_size(uncompressed_page_size);
-    dph->m_page_header.__set_compressed_page_size(compressed_page_size);
-    dph->m_page_header.__set_data_page_header(data_header);
+    dph->m_page_header.__set_compressed_page_size(uncompressed_page_size);
 
 #if defined(DEBUG)
     cerr << path_string()
@@ -444,41 +1565,292 @@ ParquetColumn::finalize_page()
          << " uncompressed_page_size " << uncompressed_page_size;
 #endif
     
+    dph->m_first_row = m_page_first_row;
+    dph->m_spill_offset = -1;
+
     m_pages.push_back(dph);
     m_num_rowgrp_values += m_num_page_values;
     m_uncompressed_size += uncompressed_page_size;
-    m_compressed_size += compressed_page_size;
+    m_pending_size += uncompressed_page_size;
+
+    if (m_codec_chosen)
+        compress_page(dph);
+    else if (m_pages.size() >= m_codec_policy.m_sample_pages)
+        choose_codec();
+    gather_pages(false);
 
     reset_page_state();
 }
 
 void
-ParquetColumn::concatenate_page_data(string & buf)
+ParquetColumn::compress_page(DataPageHandle const & dph)
 {
-    buf.clear();		// Doesn't release memory
+    // The checksum is of the page as written, so after compression.
+    if (m_compression_codec == CompressionCodec::UNCOMPRESSED) {
+        if (m_page_checksum)
+            dph->checksum();
+        return;
+    }
 
-    uint8_t bitwidth = 16;
-    uint32_t len;
-    uint8_t * lenptr = (uint8_t *) &len;
-    len = m_rep_enc.len();
-    if (len) {
-        buf.append((char const *) lenptr, sizeof(len));
-        buf.append((char const *) m_rep_buf, len);
+    if (m_compression_pool) {
+        CompressionCodec::type codec = m_compression_codec;
+        int level = m_compression_level;
+        bool checksum = m_page_checksum;
+        dph->m_compressed = m_compression_pool->submit([dph, codec, level,
+                                                        checksum] {
+                dph->compress(Compressor::thread_compressor(codec, level));
+                if (checksum)
+                    dph->checksum();
+            });
     }
-    len = m_def_enc.len();
-    if (len) {
-        buf.append((char const *) lenptr, sizeof(len));
-        buf.append((char const *) m_def_buf, len);
+    else {
+        dph->compress(Compressor::thread_compressor(m_compression_codec,
+                                                    m_compression_level));
+        if (m_page_checksum)
+            dph->checksum();
+    }
+}
+
+void
+ParquetColumn::choose_codec()
+{
+    // Sample what would be compressed, only the values of
+    // DATA_PAGE_V2 pages.
+    vector<string> samples;
+    for (DataPageHandle const & dph : m_pages)
+        samples.push_back(dph->m_page_data.substr(dph->m_levels_size));
+
+    CodecLevel choice = Compressor::choose(samples, m_codec_policy);
+    m_compression_codec = choice.first;
+    m_compression_level = choice.second;
+    m_codec_chosen = true;
+
+#if defined(DEBUG)
+    cerr << path_string()
+         << " codec " << int(m_compression_codec)
+         << " level " << m_compression_level;
+#endif
+
+    // Now the held pages can go.
+    for (DataPageHandle const & dph : m_pages)
+        compress_page(dph);
+}
+
+void
+ParquetColumn::gather_pages(bool i_wait)
+{
+    // Pages held for choosing the codec aren't compressed yet.
+    if (!m_codec_chosen)
+        return;
+
+    // Move pages whose compression is done, in order, from the
+    // pending size to the compressed size.
+    for (; m_num_gathered_pages < m_pages.size(); ++m_num_gathered_pages) {
+        DataPage & page = *m_pages[m_num_gathered_pages];
+        if (page.m_compressed.valid()) {
+            if (!i_wait &&
+                page.m_compressed.wait_for(chrono::seconds(0)) !=
+                future_status::ready)
+                break;
+            page.m_compressed.get();
+        }
+        m_pending_size -= page.m_page_header.uncompressed_page_size;
+        m_compressed_size += page.m_page_header.compressed_page_size;
+
+        // A compressed page size target scales with the ratio seen.
+        m_seen_uncompressed += page.m_page_header.uncompressed_page_size;
+        m_seen_compressed += page.m_page_header.compressed_page_size;
+        if (m_seen_uncompressed)
+            m_compression_ratio =
+                double(m_seen_compressed) / m_seen_uncompressed;
+        if (m_page_policy.m_compressed && m_seen_compressed)
+            m_page_bytes = max(size_t(MIN_PAGE_SIZE), size_t(
+                m_page_policy.m_max_bytes *
+                (double(m_seen_uncompressed) / m_seen_compressed)));
+
+        // Pages gathered for the row group being written stay, they
+        // would only be read straight back.
+        if (m_spill_file && !i_wait) {
+            page.m_spill_offset = m_spill_file->append(page.m_page_data);
+            string().swap(page.m_page_data);
+        }
+        else {
+            m_held_page_size += page.m_page_data.size();
+        }
+    }
+}
+
+BufferPool &
+ParquetColumn::page_buffer_pool(size_t i_block_size)
+{
+    // One pool for each page size in use.  Never destroyed, as columns
+    // may release their buffers during static destruction.
+    static mutex & pools_mutex = *new mutex;
+    static map<size_t, unique_ptr<BufferPool> > & pools =
+        *new map<size_t, unique_ptr<BufferPool> >;
+
+    lock_guard<mutex> lock(pools_mutex);
+    unique_ptr<BufferPool> & pool = pools[i_block_size];
+    if (!pool)
+        pool.reset(new BufferPool(i_block_size,
+                                  max(size_t(1),
+                                      MAX_IDLE_BUFFERS / i_block_size),
+                                  MemoryTracker::process()));
+    return *pool;
+}
+
+void
+ParquetColumn::acquire_buffers()
+{
+    BufferPool & pool = page_buffer_pool(m_buf_size);
+    if (m_maxreplvl > 0) {
+        m_rep_buf = pool.acquire();
+        m_rep_enc.Reset(m_rep_buf, m_buf_size);
     }
+    if (m_maxdeflvl > 0) {
+        m_def_buf = pool.acquire();
+        m_def_enc.Reset(m_def_buf, m_buf_size);
+    }
+    // Dictionary indices and RLE Booleans are encoded into m_val_buf.
+    if (m_original_encoding == Encoding::PLAIN_DICTIONARY ||
+        m_original_encoding == Encoding::RLE) {
+        m_val_buf = pool.acquire();
+        m_bool_enc.Reset(m_val_buf, m_buf_size);
+    }
+    m_has_buffers = true;
+
+    // Catch up on the nulls counted so far in this page.
+    for (size_t ndx = 0; ndx < m_null_run; ++ndx) {
+        if (m_maxreplvl > 0)
+            m_rep_enc.Put(m_null_run_replvl);
+        if (m_maxdeflvl > 0)
+            m_def_enc.Put(m_null_run_deflvl);
+    }
+    m_null_run = 0;
+}
+
+void
+ParquetColumn::release_buffers()
+{
+    if (!m_has_buffers)
+        return;
+
+    m_rep_enc.Reset(NULL, 0);
+    m_def_enc.Reset(NULL, 0);
+    m_bool_enc.Reset(NULL, 0);
+
+    BufferPool & pool = page_buffer_pool(m_buf_size);
+    if (m_rep_buf)
+        pool.release(m_rep_buf);
+    if (m_def_buf)
+        pool.release(m_def_buf);
+    if (m_val_buf)
+        pool.release(m_val_buf);
+    m_rep_buf = m_def_buf = m_val_buf = NULL;
+    m_has_buffers = false;
+
+    // Any change of page size applies from here on.
+    m_buf_size = max(size_t(PAGE_SIZE), m_page_policy.m_max_bytes);
+}
+
+void
+ParquetColumn::grow_buffers()
+{
+    need_buffers();
+
+    BufferPool & old_pool = page_buffer_pool(m_buf_size);
+    m_buf_size *= 2;
+    BufferPool & pool = page_buffer_pool(m_buf_size);
+    if (m_rep_buf) {
+        uint8_t * buf = pool.acquire();
+        m_rep_enc.Relocate(buf, m_buf_size);
+        old_pool.release(m_rep_buf);
+        m_rep_buf = buf;
+    }
+    if (m_def_buf) {
+        uint8_t * buf = pool.acquire();
+        m_def_enc.Relocate(buf, m_buf_size);
+        old_pool.release(m_def_buf);
+        m_def_buf = buf;
+    }
+    if (m_val_buf) {
+        uint8_t * buf = pool.acquire();
+        m_bool_enc.Relocate(buf, m_buf_size);
+        old_pool.release(m_val_buf);
+        m_val_buf = buf;
+    }
+}
+
+void
+ParquetColumn::fit_levels(size_t i_nlvls)
+{
+    need_buffers();
+    while ((m_maxreplvl > 0 &&
+            rle_capacity(m_rep_enc, m_buf_size,
+                         impala::BitUtil::Log2(m_maxreplvl + 1)) < i_nlvls) ||
+           (m_maxdeflvl > 0 &&
+            rle_capacity(m_def_enc, m_buf_size,
+                         impala::BitUtil::Log2(m_maxdeflvl + 1)) < i_nlvls) ||
+           m_dict_ndxs.size() >
+           dict_page_capacity(m_dict_enc->m_nvals, 0, 0))
+        grow_buffers();
+}
+
+void
+ParquetColumn::encode_null_run()
+{
+    // An unbuffered page holds nothing but the null run.
+    m_rep_run_len = 0;
+    m_def_run_len = 0;
+    if (m_maxreplvl > 0)
+        m_rep_run_len = rle_run(m_rep_run_buf, m_null_run, m_null_run_replvl,
+                                impala::BitUtil::Log2(m_maxreplvl + 1));
+    if (m_maxdeflvl > 0)
+        m_def_run_len = rle_run(m_def_run_buf, m_null_run, m_null_run_deflvl,
+                                impala::BitUtil::Log2(m_maxdeflvl + 1));
+}
+
+void
+ParquetColumn::page_levels(uint8_t const * & o_rep, size_t & o_rep_len,
+                           uint8_t const * & o_def, size_t & o_def_len)
+{
+    if (m_has_buffers) {
+        o_rep = m_rep_buf;
+        o_rep_len = m_rep_enc.len();
+        o_def = m_def_buf;
+        o_def_len = m_def_enc.len();
+    }
+    else {
+        o_rep = m_rep_run_buf;
+        o_rep_len = m_rep_run_len;
+        o_def = m_def_run_buf;
+        o_def_len = m_def_run_len;
+    }
+}
+
+string &
+ParquetColumn::page_values()
+{
+    // The encoded values section of the page.
+    uint8_t bitwidth = m_val_bitwidth;
+    uint32_t len;
     switch (m_encoding) {
     case Encoding::PLAIN:
-        buf.append(m_data);
-        break;
+        return m_data;
     case Encoding::PLAIN_DICTIONARY:
-        buf.append((char const *) &bitwidth, 1);
-        len = m_val_enc.len();
-        buf.append((char const *) m_val_buf, len);
-        break;
+        m_enc_data.assign((char const *) &bitwidth, 1);
+        m_enc_data.append((char const *) m_val_buf, m_val_len);
+        return m_enc_data;
+    case Encoding::DELTA_BINARY_PACKED:
+    case Encoding::DELTA_LENGTH_BYTE_ARRAY:
+    case Encoding::DELTA_BYTE_ARRAY:
+    case Encoding::BYTE_STREAM_SPLIT:
+        return m_enc_data;
+    case Encoding::RLE:
+        len = m_bool_enc.len();
+        m_enc_data.assign((char const *) &len, sizeof(len));
+        m_enc_data.append((char const *) m_val_buf, len);
+        return m_enc_data;
     default:
         cerr << "unsupported encoding: " << int(m_encoding);
         exit(1);
@@ -486,16 +1858,53 @@ ParquetColumn::concatenate_page_data(string & buf)
     }
 }
 
+void
+ParquetColumn::concatenate_page_data(string & buf)
+{
+    buf.clear();		// Doesn't release memory
+
+    uint8_t const * rep_levels;
+    uint8_t const * def_levels;
+    size_t rep_len;
+    size_t def_len;
+    page_levels(rep_levels, rep_len, def_levels, def_len);
+
+    uint32_t len;
+    uint8_t * lenptr = (uint8_t *) &len;
+    len = rep_len;
+    if (len) {
+        buf.append((char const *) lenptr, sizeof(len));
+        buf.append((char const *) rep_levels, len);
+    }
+    len = def_len;
+    if (len) {
+        buf.append((char const *) lenptr, sizeof(len));
+        buf.append((char const *) def_levels, len);
+    }
+    buf.append(page_values());
+}
+
 void
 ParquetColumn::reset_page_state()
 {
     m_data.clear();
     m_num_page_values = 0;
+    m_num_page_nulls = 0;
+    m_num_page_recs = 0;
     m_rep_enc.Clear();
     m_def_enc.Clear();
-    m_val_enc.Clear();
+    m_dict_ndxs.clear();
+    m_val_lens.clear();
+    m_enc_data.clear();
+    m_val_bitwidth = 0;
+    m_val_len = 0;
     m_bool_buf = 0;
     m_bool_cnt = 0;
+    m_bool_enc.Clear();
+    m_null_run = 0;
+    m_rep_run_len = 0;
+    m_def_run_len = 0;
+    m_page_stats->clear();
 }
 
 void
@@ -503,17 +1912,41 @@ ParquetColumn::reset_row_group_state()
 {
     reset_page_state();
 
+    // Give up the storage grown for this row group, the next one may
+    // need far less.
+    string().swap(m_data);
+    string().swap(m_enc_data);
+    string().swap(m_concat_buffer);
+    vector<uint32_t>().swap(m_dict_ndxs);
+    vector<int32_t>().swap(m_val_lens);
+    vector<uint64_t>().swap(m_bloom_hashes);
+    release_buffers();
+
     m_encoding = m_original_encoding;
     m_encodings.clear();
     m_encodings.push_back(m_original_encoding);
     
     m_pages.clear();
+    m_codec_chosen = !m_auto_codec;
     m_num_rowgrp_recs = 0L;
     m_num_rowgrp_values = 0L;
-    m_column_write_offset = -1L;
     m_uncompressed_size = 0L;
     m_compressed_size = 0L;
-    m_dict_enc.clear();
+    m_num_gathered_pages = 0;
+    m_pending_size = 0;
+    m_held_page_size = 0;
+    m_num_rowgrp_nulls = 0;
+    m_chunk_stats->clear();
+    m_dict_enc->clear();
+    m_dict_enc->allow_overflow(false);
+    m_fallback_pending = false;
+    m_dict_num_values = 0;
+    m_dict_plain_size = 0;
+    m_dict_next_check = m_dict_policy.m_check_interval;
+
+    // The filter just written belongs to the file writer now.
+    if (m_bloom_filter)
+        m_bloom_filter = make_shared<BloomFilter>(m_bloom_ndv, m_bloom_fpp);
 }
 
 } // end namespace parquet_file
@@ -18,8 +18,15 @@
 
 #include "parquet_types.h"
 
+#include "bloom_filter.h"
+#include "buffer_pool.h"
+#include "byte_stream_split.h"
+#include "column_statistics.h"
 #include "compressor.h"
+#include "delta_encoder.h"
 #include "dictionary_encoder.h"
+#include "spill_file.h"
+#include "thread_pool.h"
 
 namespace parquet_file {
 
@@ -29,6 +36,104 @@ class ParquetColumn;
 typedef std::shared_ptr<ParquetColumn> ParquetColumnHandle;
 typedef std::vector<ParquetColumnHandle> ParquetColumnSeq;
 
+// Page index of a column chunk, written ahead of the file footer.
+struct PageIndex
+{
+    PageIndex();
+
+    bool m_has_column_index;	// Not if some page lacked bounds
+    parquet::ColumnIndex m_column_index;
+    parquet::OffsetIndex m_offset_index;
+};
+typedef std::shared_ptr<PageIndex> PageIndexHandle;
+
+// A finished data page.
+struct DataPage
+{
+    parquet::PageHeader	m_page_header;
+    std::string			m_header;		// Serialized m_page_header
+    std::string			m_page_data;
+    size_t				m_first_row;	// Within the row group
+    size_t				m_levels_size;	// V2 levels, never compressed
+    std::future<void>	m_compressed;	// Pending pool compression
+    off_t				m_spill_offset;	// Of m_page_data once spilled, or -1
+
+    // Compresses m_page_data, less any V2 levels, in place.
+    void compress(Compressor & io_compressor);
+
+    // Sets the header's CRC of m_page_data as it will be written.
+    void checksum();
+};
+typedef std::shared_ptr<DataPage> DataPageHandle;
+typedef std::deque<DataPageHandle> DataPageSeq;
+
+class ChunkBuffer;
+typedef std::shared_ptr<ChunkBuffer> ChunkBufferHandle;
+
+// A finished column chunk, detached from its column so it can be
+// written while the column accumulates the next row group.
+class ChunkBuffer
+{
+public:
+    size_t size() const;
+
+    // Bytes held in memory until the chunk is written.
+    size_t memory_usage() const;
+
+    // Writes the chunk at i_offset with pwrite, leaving the file
+    // offset alone, so chunks may be written concurrently.  The
+    // pages are released once written.
+    parquet::ColumnMetaData write(int fd, off_t i_offset);
+
+    // Available once the chunk is written.
+    PageIndexHandle const & page_index() const;
+
+    BloomFilterHandle const & bloom_filter() const;
+
+private:
+    friend class ParquetColumn;
+
+    void index_page(PageIndex & io_index,
+                    DataPage const & i_page,
+                    off_t i_offset,
+                    size_t i_header_size) const;
+
+    parquet::BoundaryOrder::type
+    boundary_order(parquet::ColumnIndex const & i_index) const;
+
+    std::string m_dict_page;		// Serialized header and data
+    DataPageSeq m_pages;
+    SpillFileHandle m_spill_file;	// Holds the spilled page data
+    size_t m_memory_usage;
+    parquet::ColumnMetaData m_metadata;	// All but the offset
+    ColumnStatisticsHandle m_stats;	// Orders the page bounds
+    bool m_collect_index;
+    PageIndexHandle m_page_index;
+    BloomFilterHandle m_bloom_filter;
+};
+
+// Controls when a dictionary encoded column chunk gives up and falls
+// back to PLAIN for the rest of the chunk.
+struct DictionaryPolicy
+{
+    DictionaryPolicy();
+
+    size_t m_max_bytes;			// Cap on the dictionary page size
+    size_t m_max_value_size;	// Larger values fall back unhashed
+    size_t m_check_interval;	// Values between benefit checks
+    double m_max_distinct_ratio;	// Limit on distinct / total values
+};
+
+// Controls where data pages are cut.
+struct PagePolicy
+{
+    PagePolicy();
+
+    size_t m_max_bytes;			// Target page size
+    size_t m_max_rows;			// Cap on records per page, 0 for none
+    bool m_compressed;			// Measure m_max_bytes after compression
+};
+
 class ParquetColumn
 {
 public:
@@ -41,13 +146,73 @@ public:
                   parquet::Encoding::type i_encoding,
                   parquet::CompressionCodec::type i_compression_codec);
 
+    ~ParquetColumn();
+
     void add_child(ParquetColumnHandle const & ch);
 
+    void set_dictionary_policy(DictionaryPolicy const & i_policy);
+
+    // The level and dictionary index buffers grow to the page size;
+    // a new size takes effect from the next row group if the column
+    // already holds them.  Pages must allow at least 1 KB.
+    void set_page_policy(PagePolicy const & i_policy);
+
+    // Emit DATA_PAGE_V2 pages: levels are left uncompressed ahead of
+    // the values and pages start and end on record boundaries.
+    void set_data_page_v2(bool i_data_page_v2);
+
+    // Collect a page index for each column chunk (off by default).
+    // Pages of indexed columns start on record boundaries.
+    void set_page_index(bool i_page_index);
+
+    // Set PageHeader.crc on every page, dictionary pages included.
+    void set_page_checksum(bool i_page_checksum);
+
+    // Build a Bloom filter of each column chunk's values, sized for
+    // i_ndv distinct values at a false positive rate of i_fpp.
+    void set_bloom_filter(size_t i_ndv, double i_fpp);
+
+    // Codec specific compression level, 0 for the codec's default.
+    void set_compression_level(int i_level);
+
+    // Choose each column chunk's codec and level by trial compressing
+    // its first pages, instead of using the constructor's codec; those
+    // pages are held uncompressed until then.  Call before adding data.
+    void set_codec_policy(CodecPolicy const & i_policy);
+
+    // Compress finished pages on the pool's workers rather than in
+    // the calling thread; they are gathered in order before the row
+    // group is written.
+    void set_compression_pool(ThreadPoolHandle const & i_pool);
+
+    // Move each finished page's data out to i_spill_file, which the
+    // columns of a file share, until the row group is written, so only
+    // page headers stay in memory.  NULL keeps the pages in memory (the
+    // default).
+    void set_spill_file(SpillFileHandle const & i_spill_file);
+
     void add_datum(void const * i_ptr, size_t i_size, bool i_isvarlen,
                    int i_replvl, int i_deflvl);
 
     void add_boolean_datum(bool i_val, int i_replvl, int i_deflvl);
 
+    // Append a batch of booleans, levels as for add_values.
+    void add_boolean_values(bool const * i_vals,
+                            size_t i_nlvls,
+                            int16_t const * i_replvls,
+                            int16_t const * i_deflvls);
+
+    // Append a batch of fixed-width values.  There are i_nlvls
+    // entries in the level arrays; i_vals holds one value for each
+    // entry whose definition level is the column maximum.  Either
+    // level array may be NULL, meaning all zero repetition levels or
+    // all maximum definition levels respectively.
+    template<typename T>
+    void add_values(T const * i_vals,
+                    size_t i_nlvls,
+                    int16_t const * i_replvls,
+                    int16_t const * i_deflvls);
+
     std::string name() const;
 
     parquet::Type::type data_type() const;
@@ -68,6 +233,18 @@ public:
 
     size_t estimated_rowgrp_size() const;
 
+    // Keep *io_total up to date with changes to the estimated row
+    // group size as data is added; NULL to stop.
+    void track_rowgrp_size(size_t * io_total);
+
+    // Bytes held by the page and level buffers, the dictionary, the
+    // Bloom filter and the pages of the row group so far.
+    size_t memory_usage() const;
+
+    // The part of memory_usage that writing the row group doesn't
+    // free: the Bloom filter is replaced by another of the same size.
+    size_t fixed_memory_usage() const;
+
     class Traverser
     {
     public:
@@ -76,39 +253,187 @@ public:
 
     void traverse(Traverser & tt);
 
-    parquet::ColumnMetaData write_row_group(int fd,
-                    apache::thrift::protocol::TCompactProtocol * protocol);
+    // Finish the column chunk and hand it over to be written,
+    // leaving the column ready for the next row group.
+    ChunkBufferHandle detach_row_group();
 
     parquet::SchemaElement schema_element() const;
 
 private:
     static size_t const PAGE_SIZE = 64 * 1024;
+    static size_t const MIN_PAGE_SIZE = 1024;	// Room for any fixed value
+    static size_t const MAX_IDLE_BUFFERS = 16 * 1024 * 1024; // Bytes per pool
 
-    struct DataPage
+    inline void check_full(size_t i_size, int i_replvl)
     {
-        parquet::PageHeader	m_page_header;
-        std::string			m_page_data;
-
-        size_t
-        write_page(int fd,
-                   apache::thrift::protocol::TCompactProtocol * protocol);
-    };
-    typedef std::shared_ptr<DataPage> DataPageHandle;
-    typedef std::deque<DataPageHandle> DataPageSeq;
+        // The fixed size buffers can't be overrun.  Short of that,
+        // aligned pages are only cut at the start of a record, while
+        // the buffers still have an eighth to spare to get there; a
+        // record which outgrows them grows the buffers instead.
+        if (!aligns_records()) {
+            if (buffers_full(0) || page_full(i_size, i_replvl))
+                finalize_page();
+        }
+        else if (i_replvl == 0) {
+            if (buffers_full(m_buf_size / 8) || page_full(i_size, i_replvl))
+                finalize_page();
+        }
+        else if (buffers_full(0)) {
+            grow_buffers();
+        }
+    }
 
-    inline void check_full(size_t i_size)
+    inline void make_room(int i_replvl)
     {
-        if (m_data.size() + i_size > PAGE_SIZE ||
-            m_rep_enc.IsFull() ||
-            m_def_enc.IsFull() ||
-            m_val_enc.IsFull())
+        // For a batch which found the buffers or page full: aligned
+        // pages part way through a record can't be cut.
+        if (aligns_records() && i_replvl != 0 && m_num_page_values > 0)
+            grow_buffers();
+        else
             finalize_page();
     }
+
+    inline bool buffers_full(size_t i_reserve)
+    {
+        // Would another value leave the level, RLE boolean or index
+        // buffers with less than i_reserve bytes spare?
+        size_t limit = m_buf_size - i_reserve;
+        return m_rep_enc.IsFull() || size_t(m_rep_enc.len()) >= limit ||
+            m_def_enc.IsFull() || size_t(m_def_enc.len()) >= limit ||
+            m_bool_enc.IsFull() || size_t(m_bool_enc.len()) >= limit ||
+            (!m_dict_ndxs.empty() &&
+             m_dict_ndxs.size() >=
+             dict_page_capacity(m_dict_enc->m_nvals, i_reserve, 0));
+    }
+
+    inline bool page_full(size_t i_size, int i_replvl)
+    {
+        // Rows can only be counted off at the start of a record.
+        return page_data_size() + i_size > m_page_bytes ||
+            (i_replvl == 0 &&
+             m_page_policy.m_max_rows &&
+             m_num_page_recs >= m_page_policy.m_max_rows);
+    }
+
+    inline size_t page_data_size()
+    {
+        // The page's values so far, with the dictionary indices and
+        // RLE booleans at about their encoded size.
+        size_t size = m_data.size() + m_bool_enc.len();
+        if (!m_dict_ndxs.empty())
+            size += (m_dict_ndxs.size() *
+                     impala::BitUtil::Log2(m_dict_enc->m_nvals) + 7) / 8;
+        return size;
+    }
+
+    inline void update_rowgrp_size()
+    {
+        if (!m_rowgrp_total)
+            return;
+        size_t estimate = estimated_rowgrp_size();
+        *m_rowgrp_total += estimate;
+        *m_rowgrp_total -= m_estimated_size;
+        m_estimated_size = estimate;
+    }
+
+    inline void open_page(int i_replvl)
+    {
+        // A page opening part way through a record starts in the row
+        // that record began.
+        if (m_num_page_values == 0)
+            m_page_first_row = i_replvl == 0 || m_num_rowgrp_recs == 0
+                ? m_num_rowgrp_recs : m_num_rowgrp_recs - 1;
+    }
+
+    inline bool aligns_records() const
+    {
+        return m_data_page_v2 || m_page_index;
+    }
+
+    size_t dict_page_capacity(size_t i_nvals,
+                              size_t i_reserve,
+                              size_t i_target) const;
+
+    size_t dict_capacity(size_t i_reserve, size_t i_target) const;
     
     void add_levels(int i_replvl, int i_deflvl);
 
+    void add_levels(int16_t const * i_replvls,
+                    int16_t const * i_deflvls,
+                    size_t i_nlvls);
+
+    size_t count_values(int16_t const * i_deflvls, size_t i_nlvls) const;
+
+    size_t levels_for_values(int16_t const * i_deflvls,
+                             size_t i_nlvls,
+                             size_t i_nvals) const;
+
+    size_t buffer_capacity(int16_t const * i_deflvls,
+                           size_t i_nlvls,
+                           size_t i_reserve);
+
+    size_t batch_capacity(int16_t const * i_deflvls,
+                          size_t i_nlvls,
+                          size_t i_valsz);
+
+    size_t record_aligned(int16_t const * i_replvls,
+                          int16_t const * i_deflvls,
+                          size_t i_nlvls,
+                          size_t i_avail);
+
+    size_t rows_capacity(int16_t const * i_replvls, size_t i_nlvls) const;
+
     void finalize_page();
+
+    void gather_pages(bool i_wait);
+
+    void compress_page(DataPageHandle const & dph);
+
+    void choose_codec();
+
+    // The level and value buffers come from a pool shared by all the
+    // columns, taken on first non-null use and given back when the
+    // row group is done.  Only the buffers the levels and encoding
+    // use are taken.
+    static BufferPool & page_buffer_pool(size_t i_block_size);
+
+    inline void need_buffers()
+    {
+        if (!m_has_buffers)
+            acquire_buffers();
+    }
+
+    void acquire_buffers();
+
+    void release_buffers();
+
+    // Moves the buffers to blocks twice the size, keeping their
+    // contents.
+    void grow_buffers();
+
+    // Grows the buffers until they hold i_nlvls more levels, and the
+    // dictionary indices already added.
+    void fit_levels(size_t i_nlvls);
+
+    void encode_null_run();
+
+    void page_levels(uint8_t const * & o_rep, size_t & o_rep_len,
+                     uint8_t const * & o_def, size_t & o_def_len);
+
+    void encode_dict_ndxs();
+
+    void encode_values();
+
+    void check_dict(bool i_record_start);
+
+    void check_dict_benefit();
+
+    bool defer_fallback(int i_replvl);
+
+    void fallback_to_plain();
     
+    std::string & page_values();
+
     void concatenate_page_data(std::string & buffer);
 
     void reset_page_state();
@@ -125,32 +450,80 @@ private:
     parquet::Encoding::type m_encoding;
     std::vector<parquet::Encoding::type> m_encodings;
     parquet::CompressionCodec::type m_compression_codec;
-
-    Compressor m_compressor;
+    int m_compression_level;
+    bool m_auto_codec;			// Chosen by m_codec_policy
+    bool m_codec_chosen;		// For this column chunk
+    CodecPolicy m_codec_policy;
+    bool m_data_page_v2;
+    bool m_page_index;
+    bool m_page_checksum;
+
+    ThreadPoolHandle m_compression_pool;
     
     ParquetColumnSeq m_children;
 
     // Page accumulation
     std::string m_data;
     size_t m_num_page_values;
+    size_t m_num_page_nulls;
+    size_t m_num_page_recs;
+    size_t m_page_first_row;	// Within the row group
     impala::RleEncoder m_rep_enc;	// Repetition Level
     impala::RleEncoder m_def_enc;	// Definition Level
-    impala::RleEncoder m_val_enc;	// Dictionary Encoded Values
-    uint8_t m_rep_buf[PAGE_SIZE];
-    uint8_t m_def_buf[PAGE_SIZE];
-    uint8_t m_val_buf[PAGE_SIZE];
+    std::vector<uint32_t> m_dict_ndxs;	// Dictionary Encoded Values
+    bool m_has_buffers;			// Acquired, for this row group
+    uint8_t * m_rep_buf;		// m_buf_size each, when needed
+    uint8_t * m_def_buf;
+    uint8_t * m_val_buf;
+    size_t m_null_run;			// Levels held back while unbuffered
+    int m_null_run_replvl;
+    int m_null_run_deflvl;
+    uint8_t m_rep_run_buf[16];		// The null run as a single RLE run
+    uint8_t m_def_run_buf[16];
+    size_t m_rep_run_len;
+    size_t m_def_run_len;
+    int m_val_bitwidth;
+    size_t m_val_len;
+    std::vector<int32_t> m_val_lens;	// Delta byte array value lengths
+    DeltaBinaryPackedEncoder m_delta_enc;
+    DeltaByteArrayEncoder m_delta_ba_enc;
+    std::string m_enc_data;		// m_data as encoded at page end
     std::string m_concat_buffer;
     uint8_t m_bool_buf;
     int m_bool_cnt;
+    impala::RleEncoder m_bool_enc;	// RLE Booleans, in m_val_buf
     
     // Row-Group accumulation
     DataPageSeq m_pages;
+    SpillFileHandle m_spill_file;	// Shared with the file's columns
     size_t m_num_rowgrp_recs;
     size_t m_num_rowgrp_values;
-    off_t m_column_write_offset;
     size_t m_uncompressed_size;
     size_t m_compressed_size;
-    DictionaryEncoder m_dict_enc;
+    size_t m_num_gathered_pages;	// Leading pages counted in the sizes
+    size_t m_pending_size;		// Uncompressed size of the rest
+    size_t m_held_page_size;	// Gathered page data still in memory
+    size_t m_num_rowgrp_nulls;
+    ColumnStatisticsHandle m_page_stats;
+    ColumnStatisticsHandle m_chunk_stats;
+    DictionaryEncoderHandle m_dict_enc;
+    BloomFilterHandle m_bloom_filter;
+    size_t m_bloom_ndv;
+    double m_bloom_fpp;
+    std::vector<uint64_t> m_bloom_hashes;
+    DictionaryPolicy m_dict_policy;
+    size_t m_dict_num_values;	// Values dictionary encoded in this chunk
+    size_t m_dict_plain_size;	// Their size had they been PLAIN
+    size_t m_dict_next_check;
+    bool m_fallback_pending;	// At the next record start
+    PagePolicy m_page_policy;
+    size_t m_buf_size;
+    size_t m_page_bytes;		// m_max_bytes before compression
+    size_t m_seen_uncompressed;	// Page sizes so far, for the ratio
+    size_t m_seen_compressed;
+    double m_compression_ratio;		// Compressed / uncompressed pages
+    size_t * m_rowgrp_total;		// Sum of the tracked estimates
+    size_t m_estimated_size;		// Our part of it
 };
 
 } // end namespace parquet_file
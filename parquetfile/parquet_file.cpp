@@ -7,6 +7,7 @@
 
 #include <fcntl.h>
 
+#include <chrono>
 #include <iostream>
 #include <set>
 
@@ -19,9 +20,25 @@ namespace parquet_file {
 
 char const * PARQUET_MAGIC = "PAR1";
 
+// Longest wait for other writers to release memory, after which we
+// write our row group early instead.
+chrono::milliseconds const MAX_BACKPRESSURE_WAIT(1000);
+
+// Short of a wait in vain, row groups are only written early, to
+// relieve memory pressure, once the columns hold this fraction of the
+// row group size or the budget, whichever is less.
+double const MIN_EARLY_ROWGRP = 0.25;
+
 ParquetFile::ParquetFile(string const & i_path, size_t i_rowgrpsz)
     : m_path(i_path)
     , m_rowgrpsz(i_rowgrpsz)
+    , m_async_flush(false)
+    , m_tracker(MemoryTracker::process())
+    , m_tracked_size(0)
+    , m_retained_size(0)
+    , m_fixed_size(0)
+    , m_rowgrp_size(0)
+    , m_stalled(false)
     , m_num_rows(0)
     , m_nchecks(0)
 {
@@ -43,6 +60,16 @@ ParquetFile::ParquetFile(string const & i_path, size_t i_rowgrpsz)
     m_file_meta_data.__set_created_by("Apsalar");
 }
 
+ParquetFile::~ParquetFile()
+{
+    for (ParquetColumnHandle const & ch : m_leaf_cols)
+        ch->track_rowgrp_size(NULL);
+    if (m_flushing.valid())
+        m_flushing.wait();
+    m_tracker->adjust(-ssize_t(m_tracked_size));
+    m_tracker->adjust_retained(-ssize_t(m_retained_size + m_fixed_size));
+}
+
 class SchemaBuilder : public ParquetColumn::Traverser
 {
 public:
@@ -80,41 +107,129 @@ ParquetFile::set_root(ParquetColumnHandle const & col)
         if (ch->is_leaf())
             m_leaf_cols.push_back(ch);
     }
+
+    // The leaf columns keep the row group size current as they grow.
+    for (ParquetColumnHandle const & ch : m_leaf_cols)
+        ch->track_rowgrp_size(&m_rowgrp_size);
 }
 
-class RowGroupSizer : public ParquetColumn::Traverser
+void
+ParquetFile::set_worker_threads(size_t i_nthreads)
 {
-public:
-    RowGroupSizer() : m_rowgrp_size(0L) {}
-    
-    virtual void operator()(ParquetColumnHandle const & ch) {
-        m_rowgrp_size += ch->estimated_rowgrp_size();
-    }
-    size_t m_rowgrp_size;
-};
+    // A few tasks per worker may queue up before submitters wait.
+    if (i_nthreads > 0)
+        m_workers = make_shared<ThreadPool>(i_nthreads, 4 * i_nthreads);
+    else
+        m_workers.reset();
+
+    for (ParquetColumnHandle const & ch : m_leaf_cols)
+        ch->set_compression_pool(m_workers);
+}
+
+void
+ParquetFile::set_async_flush(bool i_async_flush)
+{
+    m_async_flush = i_async_flush;
+}
+
+void
+ParquetFile::set_spill_directory(string const & i_dir)
+{
+    // One scratch file serves all the columns.
+    SpillFileHandle spill_file;
+    if (!i_dir.empty())
+        spill_file = make_shared<SpillFile>(i_dir);
+    for (ParquetColumnHandle const & ch : m_leaf_cols)
+        ch->set_spill_file(spill_file);
+}
+
+void
+ParquetFile::set_memory_tracker(MemoryTrackerHandle const & i_tracker)
+{
+    // A row group in flight settles its accounts with m_tracker.
+    if (m_flushing.valid())
+        m_flushing.wait();
+
+    m_tracker->adjust(-ssize_t(m_tracked_size));
+    m_tracker->adjust_retained(-ssize_t(m_retained_size + m_fixed_size));
+    m_tracker = i_tracker;
+    m_tracker->adjust(m_tracked_size);
+    m_tracker->adjust_retained(m_retained_size + m_fixed_size);
+}
 
 void
 ParquetFile::check_rowgrp_size()
 {
-    // Only check every Nth time we are called.
+    // The aggregate row group size is kept current by the columns,
+    // write as soon as we are getting too big.
+    if (m_rowgrp_size >= m_rowgrpsz) {
+        flush_row_group();
+        return;
+    }
+
+    // Only check memory every Nth time we are called.
     if (++m_nchecks % 100 != 0)
         return;
-    
-    // Check the aggregate row group size and write if we are getting
-    // too big.
 
-    RowGroupSizer sizer;
-    sizer(m_root);
-    m_root->traverse(sizer);
+    track_memory();
 
-    if (sizer.m_rowgrp_size >= m_rowgrpsz)
-        write_row_group();
+    if (!m_tracker->over_budget()) {
+        m_stalled = false;
+        return;
+    }
+
+    // Our own row group in flight is about to give memory back.
+    if (m_flushing.valid() &&
+        m_flushing.wait_for(chrono::seconds(0)) != future_status::ready) {
+        m_flushing.wait();
+        if (!m_tracker->over_budget())
+            return;
+    }
+
+    // Other writers holding memory may flush theirs; we wait for them
+    // unless an earlier wait was in vain.  Otherwise we give up what
+    // we hold, unless it is too little to help and would make a
+    // needlessly small row group, but always after waiting in vain,
+    // lest all the writers hold a little and none flushes.
+    bool waited = false;
+    if (!m_stalled && m_tracker->flushable() > m_tracked_size) {
+        if (m_tracker->wait_for_room(MAX_BACKPRESSURE_WAIT))
+            return;
+        m_stalled = true;
+        waited = true;
+    }
+    size_t limit = min(m_rowgrpsz, m_tracker->budget());
+    if (m_leaf_cols[0]->num_rowgrp_records() &&
+        (waited || m_tracked_size >= limit * MIN_EARLY_ROWGRP))
+        flush_row_group();
+}
+
+void
+ParquetFile::track_memory()
+{
+    // What writing the row group can't free is retained.
+    size_t usage = 0;
+    size_t fixed = 0;
+    for (ParquetColumnHandle const & ch : m_leaf_cols) {
+        usage += ch->memory_usage();
+        fixed += ch->fixed_memory_usage();
+    }
+    usage -= fixed;
+    m_tracker->adjust(ssize_t(usage) - ssize_t(m_tracked_size));
+    m_tracker->adjust_retained(ssize_t(fixed) - ssize_t(m_fixed_size));
+    m_tracked_size = usage;
+    m_fixed_size = fixed;
 }
 
 void
 ParquetFile::write_file()
 {
-    write_row_group();
+    flush_row_group().wait();
+    write_bloom_filters();
+    m_bloom_filters.clear();
+    m_tracker->adjust_retained(-ssize_t(m_retained_size));
+    m_retained_size = 0;
+    write_page_indexes();
     
     m_file_meta_data.__set_num_rows(m_num_rows);
     m_file_meta_data.__set_row_groups(m_row_groups);
@@ -125,9 +240,14 @@ ParquetFile::write_file()
     close(m_fd);
 }
 
-void
-ParquetFile::write_row_group()
+shared_future<void>
+ParquetFile::flush_row_group()
 {
+    // The previous row group must be out of the way; its chunks are
+    // all the memory we allow in flight.
+    if (m_flushing.valid())
+        m_flushing.wait();
+
     // Make sure we have the same number of records in all leaf
     // columns.
     set<size_t> colnrecs;
@@ -143,15 +263,84 @@ ParquetFile::write_row_group()
     size_t numrecs = *(colnrecs.begin());
 
     m_num_rows += numrecs;
-    
+
+    // Detaching finishes the pages here, in the columns' thread.
+    // The chunks stay accounted for until they are written.
+    vector<ChunkBufferHandle> chunks;
+    size_t chunks_size = 0;
+    for (ParquetColumnHandle const & ch : m_leaf_cols) {
+        chunks.push_back(ch->detach_row_group());
+        chunks_size += chunks.back()->memory_usage();
+    }
+    m_tracker->adjust(chunks_size);
+    track_memory();
+
+    if (m_async_flush) {
+        m_flushing = async(launch::async, [this, numrecs, chunks,
+                                           chunks_size] {
+                write_row_group(numrecs, chunks);
+                m_tracker->adjust(-ssize_t(chunks_size));
+            }).share();
+    }
+    else {
+        write_row_group(numrecs, chunks);
+        m_tracker->adjust(-ssize_t(chunks_size));
+        promise<void> done;
+        done.set_value();
+        m_flushing = done.get_future().share();
+    }
+    return m_flushing;
+}
+
+void
+ParquetFile::write_row_group(size_t i_numrecs,
+                             vector<ChunkBufferHandle> const & i_chunks)
+{
+    // Lay out the row group, then write the column chunks in place,
+    // in parallel when there are workers.
+    size_t ncols = i_chunks.size();
+    vector<off_t> offsets(ncols);
+    off_t offset = lseek(m_fd, 0, SEEK_CUR);
+    for (size_t colndx = 0; colndx < ncols; ++colndx) {
+        offsets[colndx] = offset;
+        offset += i_chunks[colndx]->size();
+    }
+
+    vector<ColumnMetaData> metadata(ncols);
+    if (m_workers) {
+        vector<future<void> > written;
+        for (size_t colndx = 0; colndx < ncols; ++colndx)
+            written.push_back(m_workers->submit([this, &i_chunks, &metadata,
+                                                 &offsets, colndx] {
+                    metadata[colndx] =
+                        i_chunks[colndx]->write(m_fd, offsets[colndx]);
+                }));
+        for (future<void> & done : written)
+            done.get();
+    }
+    else {
+        for (size_t colndx = 0; colndx < ncols; ++colndx)
+            metadata[colndx] =
+                i_chunks[colndx]->write(m_fd, offsets[colndx]);
+    }
+    lseek(m_fd, offset, SEEK_SET);
+
     RowGroup row_group;
-    row_group.__set_num_rows(numrecs);
+    row_group.__set_num_rows(i_numrecs);
     vector<ColumnChunk> column_chunks;
-    for (auto it = m_leaf_cols.begin(); it != m_leaf_cols.end(); ++it) {
-        ParquetColumnHandle const & ch = *it;
+    vector<PageIndexHandle> page_indexes;
+    vector<BloomFilterHandle> bloom_filters;
+    for (size_t colndx = 0; colndx < ncols; ++colndx) {
+        ChunkBufferHandle const & chunk = i_chunks[colndx];
+        ColumnMetaData const & column_metadata = metadata[colndx];
 
-        ColumnMetaData column_metadata =
-            ch->write_row_group(m_fd, m_protocol.get());
+        page_indexes.push_back(chunk->page_index());
+        bloom_filters.push_back(chunk->bloom_filter());
+        if (chunk->bloom_filter()) {
+            size_t filter_size = chunk->bloom_filter()->num_bytes();
+            m_tracker->adjust_retained(filter_size);
+            m_retained_size += filter_size;
+        }
 
         row_group.__set_total_byte_size
             (row_group.total_byte_size +
@@ -166,6 +355,59 @@ ParquetFile::write_row_group()
     row_group.__set_columns(column_chunks);
 
     m_row_groups.push_back(row_group);
+    m_page_indexes.push_back(page_indexes);
+    m_bloom_filters.push_back(bloom_filters);
+}
+
+void
+ParquetFile::write_bloom_filters()
+{
+    for (size_t rgndx = 0; rgndx < m_row_groups.size(); ++rgndx) {
+        vector<ColumnChunk> & chunks = m_row_groups[rgndx].columns;
+        for (size_t colndx = 0; colndx < chunks.size(); ++colndx) {
+            BloomFilterHandle const & bfh = m_bloom_filters[rgndx][colndx];
+            if (!bfh)
+                continue;
+            off_t offset = lseek(m_fd, 0, SEEK_CUR);
+            size_t length = bfh->write(m_fd, m_protocol.get());
+            chunks[colndx].meta_data.__set_bloom_filter_offset(offset);
+            chunks[colndx].meta_data.__set_bloom_filter_length(length);
+        }
+    }
+}
+
+void
+ParquetFile::write_page_indexes()
+{
+    // All the column indexes and then all the offset indexes go
+    // between the last row group and the footer.
+    for (size_t rgndx = 0; rgndx < m_row_groups.size(); ++rgndx) {
+        vector<ColumnChunk> & chunks = m_row_groups[rgndx].columns;
+        for (size_t colndx = 0; colndx < chunks.size(); ++colndx) {
+            PageIndexHandle const & pih = m_page_indexes[rgndx][colndx];
+            if (!pih ||
+                !pih->m_has_column_index ||
+                pih->m_offset_index.page_locations.empty())
+                continue;
+            off_t offset = lseek(m_fd, 0, SEEK_CUR);
+            uint32_t length = pih->m_column_index.write(m_protocol.get());
+            chunks[colndx].__set_column_index_offset(offset);
+            chunks[colndx].__set_column_index_length(length);
+        }
+    }
+
+    for (size_t rgndx = 0; rgndx < m_row_groups.size(); ++rgndx) {
+        vector<ColumnChunk> & chunks = m_row_groups[rgndx].columns;
+        for (size_t colndx = 0; colndx < chunks.size(); ++colndx) {
+            PageIndexHandle const & pih = m_page_indexes[rgndx][colndx];
+            if (!pih || pih->m_offset_index.page_locations.empty())
+                continue;
+            off_t offset = lseek(m_fd, 0, SEEK_CUR);
+            uint32_t length = pih->m_offset_index.write(m_protocol.get());
+            chunks[colndx].__set_offset_index_offset(offset);
+            chunks[colndx].__set_offset_index_length(length);
+        }
+    }
 }
 
 } // end namespace parquet_file
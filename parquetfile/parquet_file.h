@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <future>
 #include <memory>
 #include <string>
 #include <vector>
@@ -16,6 +17,7 @@
 #include <thrift/protocol/TCompactProtocol.h>
 #include <thrift/transport/TFDTransport.h>
 
+#include "memory_tracker.h"
 #include "parquet_column.h"
 
 using apache::thrift::transport::TFDTransport;
@@ -30,14 +32,47 @@ class ParquetFile
 public:
     ParquetFile(std::string const & i_path, size_t i_rowgrpsz);
 
+    ~ParquetFile();
+
     void set_root(ParquetColumnHandle const & rh);
 
+    // Compress pages and write column chunks on i_nthreads workers
+    // shared by all the leaf columns; call after set_root.
+    void set_worker_threads(size_t i_nthreads);
+
+    // Hand the finished row group to a writer thread so the columns
+    // can fill the next one meanwhile; at most one row group is in
+    // flight, bounding memory to two.  Off by default.
+    void set_async_flush(bool i_async_flush);
+
+    // Spill finished pages of all the leaf columns to a scratch file
+    // in i_dir, none when it is empty; call after set_root.
+    void set_spill_directory(std::string const & i_dir);
+
+    // Account memory against i_tracker rather than the process-wide
+    // MemoryTracker::process().
+    void set_memory_tracker(MemoryTrackerHandle const & i_tracker);
+
+    // Also reports the memory held to the tracker; while it is over
+    // budget we wait for memory that others can free, and failing that
+    // write the row group early.
     void check_rowgrp_size();
 
+    // Detaches the current row group and writes it, in the background
+    // when flushing asynchronously.  Waits for any earlier flush first.
+    std::shared_future<void> flush_row_group();
+
     void write_file();
 
 private:
-    void write_row_group();
+    void write_row_group(size_t i_numrecs,
+                         std::vector<ChunkBufferHandle> const & i_chunks);
+
+    void write_bloom_filters();
+
+    void write_page_indexes();
+
+    void track_memory();
     
     std::string m_path;
     size_t m_rowgrpsz;
@@ -49,10 +84,21 @@ private:
     ParquetColumnHandle m_root;
 
     ParquetColumnSeq m_leaf_cols;
+    ThreadPoolHandle m_workers;
+    bool m_async_flush;
+    std::shared_future<void> m_flushing;
+    MemoryTrackerHandle m_tracker;
+    size_t m_tracked_size;	// Held by the columns, as last reported
+    size_t m_retained_size;	// Bloom filters kept for the footer
+    size_t m_fixed_size;	// Held by the columns whatever we write
+    size_t m_rowgrp_size;	// Estimated, updated by the leaf columns
+    bool m_stalled;		// Waited in vain while over budget
 
     size_t m_num_rows;
     
     std::vector<parquet::RowGroup> m_row_groups;
+    std::vector<std::vector<PageIndexHandle> > m_page_indexes;
+    std::vector<std::vector<BloomFilterHandle> > m_bloom_filters;
 
     size_t m_nchecks;
 };
@@ -0,0 +1,111 @@
+//
+// Parquet Page Spill File
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+#include "spill_file.h"
+
+using namespace std;
+
+namespace parquet_file {
+
+void
+write_at(int fd, string const & i_data, off_t i_offset)
+{
+    size_t done = 0;
+    while (done < i_data.size()) {
+        ssize_t rv = pwrite(fd, i_data.data() + done,
+                            i_data.size() - done, i_offset + done);
+        if (rv < 0) {
+            if (errno == EINTR)
+                continue;
+            cerr << "pwrite failed: " << strerror(errno);
+            exit(1);
+        }
+        done += rv;
+    }
+}
+
+SpillFile::SpillFile(string const & i_dir)
+    : m_size(0)
+{
+    string path = i_dir + "/parquet-spill-XXXXXX";
+    vector<char> tmpl(path.begin(), path.end());
+    tmpl.push_back('\0');
+
+    m_fd = mkstemp(tmpl.data());
+    if (m_fd == -1) {
+        cerr << "trouble creating spill file in " << i_dir
+             << ": " << strerror(errno);
+        exit(1);
+    }
+    unlink(tmpl.data());
+}
+
+SpillFile::~SpillFile()
+{
+    close(m_fd);
+}
+
+off_t
+SpillFile::append(string const & i_data)
+{
+    off_t offset = m_size.fetch_add(i_data.size());
+    write_at(m_fd, i_data, offset);
+    return offset;
+}
+
+void
+SpillFile::read(off_t i_offset, size_t i_size, string & o_data) const
+{
+    o_data.resize(i_size);
+    size_t done = 0;
+    while (done < i_size) {
+        ssize_t rv = pread(m_fd, &o_data[done], i_size - done,
+                           i_offset + done);
+        if (rv < 0) {
+            if (errno == EINTR)
+                continue;
+            cerr << "spill file read failed: " << strerror(errno);
+            exit(1);
+        }
+        else if (rv == 0) {
+            cerr << "spill file read: unexpected end of file at "
+                 << i_offset + done;
+            exit(1);
+        }
+        done += rv;
+    }
+}
+
+void
+SpillFile::discard(off_t i_offset, size_t i_size)
+{
+#if defined(FALLOC_FL_PUNCH_HOLE)
+    // Failure only costs disk space until the file goes.
+    fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              i_offset, i_size);
+#else
+    (void) i_offset;
+    (void) i_size;
+#endif
+}
+
+off_t
+SpillFile::size() const
+{
+    return m_size;
+}
+
+} // end namespace parquet_file
@@ -0,0 +1,58 @@
+//
+// Parquet Page Spill File
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace parquet_file {
+
+class SpillFile;
+typedef std::shared_ptr<SpillFile> SpillFileHandle;
+
+// Writes all of i_data at i_offset without moving the file offset,
+// so several writers can share fd.
+void write_at(int fd, std::string const & i_data, off_t i_offset);
+
+// An anonymous scratch file holding finished pages of the column
+// chunks of a file until their row group is written.  The file is
+// unlinked as soon as it is created and goes away when the last
+// handle does.
+class SpillFile
+{
+public:
+    SpillFile(std::string const & i_dir);
+
+    ~SpillFile();
+
+    // Appends i_data, returns the offset it was written at.  Safe to
+    // call from several threads.
+    off_t append(std::string const & i_data);
+
+    // Reads i_size bytes at i_offset into o_data.
+    void read(off_t i_offset, size_t i_size, std::string & o_data) const;
+
+    // Gives back the space of data read for the last time, where the
+    // file system allows.
+    void discard(off_t i_offset, size_t i_size);
+
+    off_t size() const;
+
+private:
+    int m_fd;
+    std::atomic<off_t> m_size;
+};
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
@@ -0,0 +1,79 @@
+//
+// Parquet Worker Thread Pool
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#include <stdlib.h>
+
+#include <iostream>
+
+#include "thread_pool.h"
+
+using namespace std;
+
+namespace parquet_file {
+
+ThreadPool::ThreadPool(size_t i_nthreads, size_t i_max_queued)
+    : m_max_queued(max(i_max_queued, size_t(1)))
+    , m_stopping(false)
+{
+    if (i_nthreads == 0) {
+        cerr << "ThreadPool: needs at least one thread";
+        exit(1);
+    }
+
+    for (size_t ndx = 0; ndx < i_nthreads; ++ndx)
+        m_threads.push_back(thread(&ThreadPool::run, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_not_empty.notify_all();
+
+    for (thread & worker : m_threads)
+        worker.join();
+}
+
+future<void>
+ThreadPool::submit(function<void()> const & i_task)
+{
+    packaged_task<void()> task(i_task);
+    future<void> result = task.get_future();
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this] {
+                return m_tasks.size() < m_max_queued;
+            });
+        m_tasks.push_back(move(task));
+    }
+    m_not_empty.notify_one();
+    return result;
+}
+
+void
+ThreadPool::run()
+{
+    while (true) {
+        packaged_task<void()> task;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_not_empty.wait(lock, [this] {
+                    return m_stopping || !m_tasks.empty();
+                });
+            if (m_tasks.empty())
+                return;		// Stopping, and nothing left to do
+            task = move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        m_not_full.notify_one();
+        task();
+    }
+}
+
+} // end namespace parquet_file
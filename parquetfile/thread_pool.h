@@ -0,0 +1,52 @@
+//
+// Parquet Worker Thread Pool
+//
+// Copyright (c) 2016 Apsalar Inc.
+// All rights reserved.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parquet_file {
+
+class ThreadPool;
+typedef std::shared_ptr<ThreadPool> ThreadPoolHandle;
+
+// A fixed set of worker threads draining a bounded task queue.
+class ThreadPool
+{
+public:
+    // Submitters block while i_max_queued tasks are waiting.
+    ThreadPool(size_t i_nthreads, size_t i_max_queued);
+
+    // Runs the tasks still queued before joining the workers.
+    ~ThreadPool();
+
+    std::future<void> submit(std::function<void()> const & i_task);
+
+private:
+    void run();
+
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::deque<std::packaged_task<void()> > m_tasks;
+    std::vector<std::thread> m_threads;
+    size_t m_max_queued;
+    bool m_stopping;
+};
+
+} // end namespace parquet_file
+
+// Local Variables:
+// mode: C++
+// End:
@@ -42,6 +42,21 @@ class BitWriter {
     bit_offset_ = 0;
   }
 
+  /// Switches to writing 'buffer', discarding anything written.
+  void Reset(uint8_t* buffer, int buffer_len) {
+    buffer_ = buffer;
+    max_bytes_ = buffer_len;
+    Clear();
+  }
+
+  /// Copies what was written to 'buffer', which must be large enough to hold it,
+  /// and carries on writing there.
+  void Relocate(uint8_t* buffer, int buffer_len) {
+    memcpy(buffer, buffer_, byte_offset_);
+    buffer_ = buffer;
+    max_bytes_ = buffer_len;
+  }
+
   /// The number of current bytes written, including the current byte (i.e. may include a
   /// fraction of a byte). Includes buffered values.
   int bytes_written() const { return byte_offset_ + BitUtil::Ceil(bit_offset_, 8); }
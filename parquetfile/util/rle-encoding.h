@@ -20,6 +20,7 @@
 #include "util/compiler-util.h"
 #include "util/bit-stream-utils.inline.h"
 #include "util/bit-util.h"
+#include "bit_packing.h"
 
 #define DCHECK_LT(xxx, yyy)
 #define DCHECK_LE(xxx, yyy)
@@ -144,6 +145,7 @@ class RleEncoder {
     DCHECK_GE(bit_width_, 0);
     DCHECK_LE(bit_width_, 64);
     max_run_byte_size_ = MinBufferSize(bit_width);
+    pack8_ = parquet_file::pack8_func(bit_width);
     Clear();
   }
 
@@ -174,6 +176,12 @@ class RleEncoder {
   /// This value must be representable with bit_width_ bits.
   bool Put(uint64_t value);
 
+  /// Encodes values as repeated Put() calls would, but bit packs literal
+  /// groups of 8 without buffering them value by value.  Returns the number of
+  /// values that fit in the buffer.
+  template<typename T>
+  int PutBatch(const T* values, int num_values);
+
   /// Flushes any pending values to the underlying buffer.
   /// Returns the total number of bytes written
   int Flush();
@@ -181,6 +189,22 @@ class RleEncoder {
   /// Resets all the state in the encoder.
   void Clear();
 
+  /// Switches to encoding into 'buffer', discarding anything encoded.
+  void Reset(uint8_t* buffer, int buffer_len) {
+    bit_writer_.Reset(buffer, buffer_len);
+    Clear();
+  }
+
+  /// Copies what was encoded to 'buffer', which must be large enough to hold it,
+  /// and carries on encoding there, the run in progress included.
+  void Relocate(uint8_t* buffer, int buffer_len) {
+    if (literal_indicator_byte_ != NULL)
+      literal_indicator_byte_ = buffer + (literal_indicator_byte_ - bit_writer_.buffer());
+    bit_writer_.Relocate(buffer, buffer_len);
+    buffer_full_ = false;
+    CheckBufferFull();
+  }
+
   /// Returns pointer to underlying buffer
   uint8_t* buffer() { return bit_writer_.buffer(); }
   int32_t len() { return bit_writer_.bytes_written(); }
@@ -247,6 +271,9 @@ class RleEncoder {
   /// This is reserved as soon as we need a literal run but the value is written
   /// when the literal run is complete.
   uint8_t* literal_indicator_byte_;
+
+  /// Packs a whole group of 8 literals at once, NULL if bit_width_ is too wide.
+  parquet_file::Pack8Func pack8_;
 };
 
 template<typename T>
@@ -327,6 +354,32 @@ inline bool RleEncoder::Put(uint64_t value) {
   return true;
 }
 
+template<typename T>
+inline int RleEncoder::PutBatch(const T* values, int num_values) {
+  int i = 0;
+  while (i < num_values) {
+    // Between groups of a literal run, a group of 8 that are not all the same
+    // can only continue it.  Anything else goes through Put().
+    if (num_buffered_values_ == 0 && repeat_count_ == 0 &&
+        num_values - i >= 8 && LIKELY(!buffer_full_)) {
+      const T* group = values + i;
+      bool all_same = true;
+      for (int j = 1; j < 8; ++j) all_same &= group[j] == group[0];
+      if (!all_same) {
+        for (int j = 0; j < 8; ++j) buffered_values_[j] = group[j];
+        num_buffered_values_ = 8;
+        current_value_ = group[7];
+        FlushBufferedValues(false);
+        i += 8;
+        continue;
+      }
+    }
+    if (!Put(values[i])) break;
+    ++i;
+  }
+  return i;
+}
+
 inline void RleEncoder::FlushLiteralRun(bool update_indicator_byte) {
   if (literal_indicator_byte_ == NULL) {
     // The literal indicator byte has not been reserved yet, get one now.
@@ -334,10 +387,18 @@ inline void RleEncoder::FlushLiteralRun(bool update_indicator_byte) {
     DCHECK(literal_indicator_byte_ != NULL);
   }
 
-  // Write all the buffered values as bit packed literals
-  for (int i = 0; i < num_buffered_values_; ++i) {
-      bool success = bit_writer_.PutValue(buffered_values_[i], bit_width_);
-      (void) success;
+  // Write all the buffered values as bit packed literals.  Groups start on a
+  // byte boundary so a full one is packed straight into the buffer.
+  if (pack8_ != NULL && num_buffered_values_ == 8) {
+    uint32_t group[8];
+    for (int i = 0; i < 8; ++i) group[i] = buffered_values_[i];
+    uint8_t* dst = bit_writer_.GetNextBytePtr(bit_width_);
+    if (dst != NULL) pack8_(group, dst);
+  } else {
+    for (int i = 0; i < num_buffered_values_; ++i) {
+        bool success = bit_writer_.PutValue(buffered_values_[i], bit_width_);
+        (void) success;
+    }
   }
   num_buffered_values_ = 0;
 
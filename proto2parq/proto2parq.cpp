@@ -28,6 +28,17 @@ char const * DEF_ROOTMSG = "";
 char const * DEF_INFILE = "-";
 char const * DEF_OUTFILE = "";
 double const DEF_ROWGRPMB = 256.0;
+size_t const DEF_NTHREADS = 0;
+double const DEF_MEMBUDGETMB = 0.0;
+char const * DEF_INTENC = "dictionary";
+char const * DEF_STRENC = "dictionary";
+char const * DEF_FLTENC = "dictionary";
+char const * DEF_BOOLENC = "plain";
+size_t const DEF_BLOOMNDV = 1000 * 1000;
+double const DEF_BLOOMFPP = 0.01;
+double const DEF_PAGEKB = 64.0;
+size_t const DEF_PAGEROWS = 0;
+char const * DEF_CODEC = "snappy";
 
 string g_protodir = DEF_PROTODIR;
 string g_protofile = DEF_PROTOFILE;
@@ -35,6 +46,11 @@ string g_rootmsg = DEF_ROOTMSG;
 string g_infile = DEF_INFILE;
 string g_outfile = DEF_OUTFILE;
 double g_rowgrpmb = DEF_ROWGRPMB;
+size_t g_nthreads = DEF_NTHREADS;
+bool g_async_flush = false;
+string g_spilldir;
+double g_membudgetmb = DEF_MEMBUDGETMB;
+ColumnOptions g_colopts;
 bool g_dodump = false;    
 bool g_dotrace = false;    
     
@@ -50,11 +66,146 @@ usage(int & argc, char ** & argv)
          << "    -i, --infile=PATH     protobuf data input [" << DEF_INFILE << "]" << endl
          << "    -o, --outfile=PATH    parquet output file [" << DEF_OUTFILE << "]" << endl
          << "    -s, --row-group-mb=MB row group size (MB) [" << DEF_ROWGRPMB << "]" << endl
+         << "    -j, --threads=N       worker threads [" << DEF_NTHREADS << "]" << endl
+         << "                          (0 compresses and writes in the main thread)" << endl
+         << "    -A, --async-flush     write row groups in the background" << endl
+         << "    -S, --spill-dir=DIR   spill finished pages to scratch files in DIR" << endl
+         << "    -M, --memory-budget-mb=MB memory budget (MB) [" << DEF_MEMBUDGETMB << "]" << endl
+         << "                          (0 is unlimited)" << endl
+         << "    -e, --int-encoding=ENC integer encoding [" << DEF_INTENC << "]" << endl
+         << "                          (dictionary, plain, delta)" << endl
+         << "    -E, --string-encoding=ENC string encoding [" << DEF_STRENC << "]" << endl
+         << "                          (dictionary, plain, delta-length, delta)" << endl
+         << "    -F, --float-encoding=ENC float encoding [" << DEF_FLTENC << "]" << endl
+         << "                          (dictionary, plain, split)" << endl
+         << "    -B, --bool-encoding=ENC boolean encoding [" << DEF_BOOLENC << "]" << endl
+         << "                          (plain, rle)" << endl
+         << "    -2, --page-v2         write DATA_PAGE_V2 pages" << endl
+         << "    -P, --page-index      write column and offset indexes" << endl
+         << "    -c, --page-crc        write page CRC-32 checksums" << endl
+         << "    -b, --bloom-filter=COL Bloom filter column, repeatable" << endl
+         << "                          (dotted path below the root message)" << endl
+         << "    -n, --bloom-ndv=N     distinct values per filter [" << DEF_BLOOMNDV << "]" << endl
+         << "    -f, --bloom-fpp=P     false positive rate [" << DEF_BLOOMFPP << "]" << endl
+         << "    -G, --page-kb=KB      data page size (KB) [" << DEF_PAGEKB << "]" << endl
+         << "    -R, --page-rows=N     records per data page [" << DEF_PAGEROWS << "]" << endl
+         << "                          (0 for no limit)" << endl
+         << "    -C, --page-compressed measure page size after compression" << endl
+         << "    -K, --column-page-kb=COL=KB page size of one column, repeatable" << endl
+         << "    -z, --codec=CODEC[:LEVEL] leaf column codec [" << DEF_CODEC << "]" << endl
+         << "                          (uncompressed, snappy, gzip, zstd, lz4, brotli," << endl
+         << "                          auto samples each column chunk's first pages)" << endl
+         << "    -W, --codec-cpu-weight=W auto codec score per ns/byte [" << parquet_file::CodecPolicy().m_cpu_weight << "]" << endl
          << "    -u, --dump            pretty print the schema to stderr" << endl
          << "    -t, --trace           trace input traversal" << endl
         ;
 }
 
+parquet::Encoding::type
+parse_int_encoding(string const & i_name)
+{
+    if (i_name == "dictionary")
+        return parquet::Encoding::PLAIN_DICTIONARY;
+    else if (i_name == "plain")
+        return parquet::Encoding::PLAIN;
+    else if (i_name == "delta")
+        return parquet::Encoding::DELTA_BINARY_PACKED;
+
+    cerr << "unknown int-encoding: " << i_name << endl;
+    exit(1);
+}
+
+parquet::Encoding::type
+parse_string_encoding(string const & i_name)
+{
+    if (i_name == "dictionary")
+        return parquet::Encoding::PLAIN_DICTIONARY;
+    else if (i_name == "plain")
+        return parquet::Encoding::PLAIN;
+    else if (i_name == "delta-length")
+        return parquet::Encoding::DELTA_LENGTH_BYTE_ARRAY;
+    else if (i_name == "delta")
+        return parquet::Encoding::DELTA_BYTE_ARRAY;
+
+    cerr << "unknown string-encoding: " << i_name << endl;
+    exit(1);
+}
+
+parquet::Encoding::type
+parse_float_encoding(string const & i_name)
+{
+    if (i_name == "dictionary")
+        return parquet::Encoding::PLAIN_DICTIONARY;
+    else if (i_name == "plain")
+        return parquet::Encoding::PLAIN;
+    else if (i_name == "split")
+        return parquet::Encoding::BYTE_STREAM_SPLIT;
+
+    cerr << "unknown float-encoding: " << i_name << endl;
+    exit(1);
+}
+
+parquet::Encoding::type
+parse_bool_encoding(string const & i_name)
+{
+    if (i_name == "plain")
+        return parquet::Encoding::PLAIN;
+    else if (i_name == "rle")
+        return parquet::Encoding::RLE;
+
+    cerr << "unknown bool-encoding: " << i_name << endl;
+    exit(1);
+}
+
+void
+parse_codec(string const & i_arg)
+{
+    // Without a level, the codec's default rather than any earlier
+    // -z level applies.
+    string name = i_arg;
+    g_colopts.m_codec_level = 0;
+    size_t colonpos = i_arg.find(':');
+    bool has_level = colonpos != string::npos;
+    if (has_level) {
+        name = i_arg.substr(0, colonpos);
+        char * endp;
+        g_colopts.m_codec_level =
+            strtol(i_arg.c_str() + colonpos + 1, &endp, 10);
+        if (*endp != '\0') {
+            cerr << "trouble parsing codec level" << endl;
+            exit(1);
+        }
+    }
+
+    g_colopts.m_codec_auto = false;
+    if (name == "uncompressed")
+        g_colopts.m_codec = parquet::CompressionCodec::UNCOMPRESSED;
+    else if (name == "snappy")
+        g_colopts.m_codec = parquet::CompressionCodec::SNAPPY;
+    else if (name == "gzip")
+        g_colopts.m_codec = parquet::CompressionCodec::GZIP;
+    else if (name == "zstd")
+        g_colopts.m_codec = parquet::CompressionCodec::ZSTD;
+    else if (name == "lz4")
+        g_colopts.m_codec = parquet::CompressionCodec::LZ4_RAW;
+    else if (name == "brotli")
+        g_colopts.m_codec = parquet::CompressionCodec::BROTLI;
+    else if (name == "auto")
+        g_colopts.m_codec_auto = true;
+    else {
+        cerr << "unknown codec: " << name << endl;
+        exit(1);
+    }
+
+    if (has_level &&
+        (g_colopts.m_codec_auto ||
+         g_colopts.m_codec == parquet::CompressionCodec::UNCOMPRESSED ||
+         g_colopts.m_codec == parquet::CompressionCodec::SNAPPY)) {
+        cerr << "codec " << name << " takes no level" << endl;
+        exit(1);
+    }
+}
+
 void
 parse_arguments(int & argc, char ** & argv)
 {
@@ -69,6 +220,26 @@ parse_arguments(int & argc, char ** & argv)
 	  {(char *) "infile",                  required_argument,  0, 'i'},
 	  {(char *) "outfile",                 required_argument,  0, 'o'},
 	  {(char *) "row-group-mb",            required_argument,  0, 's'},
+	  {(char *) "threads",                 required_argument,  0, 'j'},
+	  {(char *) "async-flush",             no_argument,        0, 'A'},
+	  {(char *) "spill-dir",               required_argument,  0, 'S'},
+	  {(char *) "memory-budget-mb",        required_argument,  0, 'M'},
+	  {(char *) "int-encoding",            required_argument,  0, 'e'},
+	  {(char *) "string-encoding",         required_argument,  0, 'E'},
+	  {(char *) "float-encoding",          required_argument,  0, 'F'},
+	  {(char *) "bool-encoding",           required_argument,  0, 'B'},
+	  {(char *) "page-v2",                 no_argument,        0, '2'},
+	  {(char *) "page-index",              no_argument,        0, 'P'},
+	  {(char *) "page-crc",                no_argument,        0, 'c'},
+	  {(char *) "bloom-filter",            required_argument,  0, 'b'},
+	  {(char *) "bloom-ndv",               required_argument,  0, 'n'},
+	  {(char *) "bloom-fpp",               required_argument,  0, 'f'},
+	  {(char *) "page-kb",                 required_argument,  0, 'G'},
+	  {(char *) "page-rows",               required_argument,  0, 'R'},
+	  {(char *) "page-compressed",         no_argument,        0, 'C'},
+	  {(char *) "column-page-kb",          required_argument,  0, 'K'},
+	  {(char *) "codec",                   required_argument,  0, 'z'},
+	  {(char *) "codec-cpu-weight",        required_argument,  0, 'W'},
 	  {(char *) "dump",                    no_argument,        0, 'u'},
 	  {(char *) "trace",                   no_argument,        0, 't'},
 	  {0, 0, 0, 0}
@@ -77,7 +248,7 @@ parse_arguments(int & argc, char ** & argv)
     while (true)
     {
         int optndx = 0;
-        int opt = getopt_long(argc, argv, "hd:p:m:i:o:s:ut",
+        int opt = getopt_long(argc, argv, "hd:p:m:i:o:s:j:AS:M:e:E:F:B:2Pcb:n:f:G:R:CK:z:W:ut",
                               long_options, &optndx);
 
         // Are we done processing arguments?
@@ -122,6 +293,129 @@ parse_arguments(int & argc, char ** & argv)
             }
             break;
 
+        case 'j':
+            g_nthreads = strtoul(optarg, &endp, 10);
+            if (*endp != '\0') {
+                cerr << "trouble parsing threads argument" << endl;
+                exit(1);
+            }
+            break;
+
+        case 'A':
+            g_async_flush = true;
+            break;
+
+        case 'S':
+            g_spilldir = optarg;
+            break;
+
+        case 'M':
+            g_membudgetmb = strtod(optarg, &endp);
+            if (*endp != '\0') {
+                cerr << "trouble parsing memory-budget-mb argument" << endl;
+                exit(1);
+            }
+            break;
+
+        case 'e':
+            g_colopts.m_int_encoding = parse_int_encoding(optarg);
+            break;
+
+        case 'E':
+            g_colopts.m_string_encoding = parse_string_encoding(optarg);
+            break;
+
+        case 'F':
+            g_colopts.m_float_encoding = parse_float_encoding(optarg);
+            break;
+
+        case 'B':
+            g_colopts.m_bool_encoding = parse_bool_encoding(optarg);
+            break;
+
+        case '2':
+            g_colopts.m_data_page_v2 = true;
+            break;
+
+        case 'P':
+            g_colopts.m_page_index = true;
+            break;
+
+        case 'c':
+            g_colopts.m_page_checksum = true;
+            break;
+
+        case 'b':
+            g_colopts.m_bloom_columns.insert(optarg);
+            break;
+
+        case 'n':
+            g_colopts.m_bloom_ndv = strtoul(optarg, &endp, 10);
+            if (*endp != '\0') {
+                cerr << "trouble parsing bloom-ndv argument" << endl;
+                exit(1);
+            }
+            break;
+
+        case 'f':
+            g_colopts.m_bloom_fpp = strtod(optarg, &endp);
+            if (*endp != '\0') {
+                cerr << "trouble parsing bloom-fpp argument" << endl;
+                exit(1);
+            }
+            break;
+
+        case 'G':
+            g_colopts.m_page_policy.m_max_bytes =
+                size_t(strtod(optarg, &endp) * 1024);
+            if (*endp != '\0') {
+                cerr << "trouble parsing page-kb argument" << endl;
+                exit(1);
+            }
+            break;
+
+        case 'R':
+            g_colopts.m_page_policy.m_max_rows = strtoul(optarg, &endp, 10);
+            if (*endp != '\0') {
+                cerr << "trouble parsing page-rows argument" << endl;
+                exit(1);
+            }
+            break;
+
+        case 'C':
+            g_colopts.m_page_policy.m_compressed = true;
+            break;
+
+        case 'K':
+            {
+                string arg = optarg;
+                size_t eqpos = arg.rfind('=');
+                if (eqpos == string::npos) {
+                    cerr << "column-page-kb argument needs COL=KB" << endl;
+                    exit(1);
+                }
+                double kb = strtod(arg.c_str() + eqpos + 1, &endp);
+                if (*endp != '\0') {
+                    cerr << "trouble parsing column-page-kb argument" << endl;
+                    exit(1);
+                }
+                g_colopts.m_column_page_bytes[arg.substr(0, eqpos)] =
+                    size_t(kb * 1024);
+            }
+            break;
+
+        case 'z':
+            parse_codec(optarg);
+            break;
+
+        case 'W':
+            g_colopts.m_codec_policy.m_cpu_weight = strtod(optarg, &endp);
+            if (*endp != '\0') {
+                cerr << "trouble parsing codec-cpu-weight argument" << endl;
+                exit(1);
+            }
+            break;
+
         case 't':
             g_dotrace = true;
             break;
@@ -153,6 +447,9 @@ int run(int & argc, char ** & argv)
     parse_arguments(argc, argv);
 
     size_t rowgrpsz = size_t(g_rowgrpmb * 1024 * 1024);
+
+    size_t membudget = size_t(g_membudgetmb * 1024 * 1024);
+    parquet_file::MemoryTracker::process()->set_budget(membudget);
     
     Schema schema(g_protodir,
                   g_protofile,
@@ -160,6 +457,10 @@ int run(int & argc, char ** & argv)
                   g_infile,
                   g_outfile,
                   rowgrpsz,
+                  g_nthreads,
+                  g_async_flush,
+                  g_spilldir,
+                  g_colopts,
                   g_dotrace);
 
     if (g_dodump)
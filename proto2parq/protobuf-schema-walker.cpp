@@ -101,11 +101,27 @@ private:
     ostream & m_ostrm;
 };
 
+class LeafPathCollector : public NodeTraverser
+{
+public:
+    // Paths less the root message, as the column options name them.
+    virtual void visit(SchemaNode const * np)
+    {
+        if (np->m_pqcol->is_leaf()) {
+            string path = np->m_pqcol->path_string();
+            m_paths.insert(path.substr(path.find('.') + 1));
+        }
+    }
+
+    set<string> m_paths;
+};
+
 SchemaNodeHandle
 traverse_leaf(StringSeq & path,
               FieldDescriptor const * i_fd,
               int i_maxreplvl,
               int i_maxdeflvl,
+              ColumnOptions const & i_colopts,
               bool i_dotrace)
 {
     int maxreplvl = i_fd->is_repeated() ? i_maxreplvl + 1 : i_maxreplvl;
@@ -113,7 +129,7 @@ traverse_leaf(StringSeq & path,
 
     SchemaNodeHandle retval =
         make_shared<SchemaNode>(path, (Descriptor *) NULL, i_fd,
-                                maxreplvl, maxdeflvl, i_dotrace);
+                                maxreplvl, maxdeflvl, i_colopts, i_dotrace);
     return move(retval);
 }
 
@@ -122,6 +138,7 @@ traverse_group(StringSeq & path,
                FieldDescriptor const * i_fd,
                int i_maxreplvl,
                int i_maxdeflvl,
+               ColumnOptions const & i_colopts,
                bool i_dotrace)
 {
     Descriptor const * dd = i_fd->message_type();
@@ -131,7 +148,7 @@ traverse_group(StringSeq & path,
 
     SchemaNodeHandle retval =
         make_shared<SchemaNode>(path, dd, i_fd,
-                                maxreplvl, maxdeflvl, i_dotrace);
+                                maxreplvl, maxdeflvl, i_colopts, i_dotrace);
     
     for (int ndx = 0; ndx < dd->field_count(); ++ndx) {
         FieldDescriptor const * fd = dd->field(ndx);
@@ -140,14 +157,14 @@ traverse_group(StringSeq & path,
         case FieldDescriptor::CPPTYPE_MESSAGE:
             {
                 SchemaNodeHandle child =
-                    traverse_group(path, fd, maxreplvl, maxdeflvl, i_dotrace);
+                    traverse_group(path, fd, maxreplvl, maxdeflvl, i_colopts, i_dotrace);
                 retval->add_child(child);
             }
             break;
         default:
             {
                 SchemaNodeHandle child =
-                    traverse_leaf(path, fd, maxreplvl, maxdeflvl, i_dotrace);
+                    traverse_leaf(path, fd, maxreplvl, maxdeflvl, i_colopts, i_dotrace);
                 retval->add_child(child);
             }
             break;
@@ -159,11 +176,14 @@ traverse_group(StringSeq & path,
 }
 
 SchemaNodeHandle
-traverse_root(StringSeq & path, Descriptor const * dd, bool dotrace)
+traverse_root(StringSeq & path,
+              Descriptor const * dd,
+              ColumnOptions const & colopts,
+              bool dotrace)
 {
     SchemaNodeHandle retval =
         make_shared<SchemaNode>(path, dd, (FieldDescriptor *) NULL,
-                                0, 0, dotrace);
+                                0, 0, colopts, dotrace);
     
     for (int ndx = 0; ndx < dd->field_count(); ++ndx) {
         FieldDescriptor const * fd = dd->field(ndx);
@@ -172,14 +192,14 @@ traverse_root(StringSeq & path, Descriptor const * dd, bool dotrace)
         case FieldDescriptor::CPPTYPE_MESSAGE:
             {
                 SchemaNodeHandle child =
-                    traverse_group(path, fd, 0, 0, dotrace);
+                    traverse_group(path, fd, 0, 0, colopts, dotrace);
                 retval->add_child(child);
             }
             break;
         default:
             {
                 SchemaNodeHandle child =
-                    traverse_leaf(path, fd, 0, 0, dotrace);
+                    traverse_leaf(path, fd, 0, 0, colopts, dotrace);
                 retval->add_child(child);
             }
             break;
@@ -208,11 +228,28 @@ class MyErrorCollector : public MultiFileErrorCollector
 
 namespace protobuf_schema_walker {
 
+ColumnOptions::ColumnOptions()
+    : m_int_encoding(Encoding::PLAIN_DICTIONARY)
+    , m_string_encoding(Encoding::PLAIN_DICTIONARY)
+    , m_float_encoding(Encoding::PLAIN_DICTIONARY)
+    , m_bool_encoding(Encoding::PLAIN)
+    , m_data_page_v2(false)
+    , m_page_index(false)
+    , m_page_checksum(false)
+    , m_bloom_ndv(1000 * 1000)
+    , m_bloom_fpp(0.01)
+    , m_codec(CompressionCodec::SNAPPY)
+    , m_codec_level(0)
+    , m_codec_auto(false)
+{
+}
+
 SchemaNode::SchemaNode(StringSeq const & i_path,
                        Descriptor const * i_dp,
                        FieldDescriptor const * i_fdp,
                        int i_maxreplvl,
                        int i_maxdeflvl,
+                       ColumnOptions const & i_colopts,
                        bool i_dotrace)
         : m_path(i_path)
         , m_dp(i_dp)
@@ -251,40 +288,48 @@ SchemaNode::SchemaNode(StringSeq const & i_path,
         switch (m_fdp->type()) {
         case FieldDescriptor::TYPE_DOUBLE:
             data_type = parquet::Type::DOUBLE;
+            encoding = i_colopts.m_float_encoding;
             break;
         case FieldDescriptor::TYPE_FLOAT:
             data_type = parquet::Type::FLOAT;
+            encoding = i_colopts.m_float_encoding;
             break;
         case FieldDescriptor::TYPE_INT64:
         case FieldDescriptor::TYPE_SINT64:
         case FieldDescriptor::TYPE_SFIXED64:
             data_type = parquet::Type::INT64;
+            encoding = i_colopts.m_int_encoding;
             break;
         case FieldDescriptor::TYPE_UINT64:
         case FieldDescriptor::TYPE_FIXED64:
             data_type = parquet::Type::INT64;
             converted_type = parquet::ConvertedType::UINT_64;
+            encoding = i_colopts.m_int_encoding;
             break;
         case FieldDescriptor::TYPE_INT32:
         case FieldDescriptor::TYPE_SINT32:
         case FieldDescriptor::TYPE_SFIXED32:
             data_type = parquet::Type::INT32;
+            encoding = i_colopts.m_int_encoding;
             break;
         case FieldDescriptor::TYPE_UINT32:
         case FieldDescriptor::TYPE_FIXED32:
             data_type = parquet::Type::INT32;
             converted_type = parquet::ConvertedType::UINT_32;
+            encoding = i_colopts.m_int_encoding;
             break;
         case FieldDescriptor::TYPE_BOOL:
             data_type = parquet::Type::BOOLEAN;
-            encoding = Encoding::PLAIN;
+            encoding = i_colopts.m_bool_encoding;
             break;
         case FieldDescriptor::TYPE_STRING:
             data_type = parquet::Type::BYTE_ARRAY;
             converted_type = parquet::ConvertedType::UTF8;
+            encoding = i_colopts.m_string_encoding;
             break;
         case FieldDescriptor::TYPE_BYTES:
             data_type = parquet::Type::BYTE_ARRAY;
+            encoding = i_colopts.m_string_encoding;
             break;
         case FieldDescriptor::TYPE_MESSAGE:
         case FieldDescriptor::TYPE_GROUP:
@@ -308,8 +353,7 @@ SchemaNode::SchemaNode(StringSeq const & i_path,
             m_fdp->is_optional() ? FieldRepetitionType::OPTIONAL :
             FieldRepetitionType::REPEATED;
 
-        CompressionCodec::type compression_codec =
-            CompressionCodec::SNAPPY;
+        CompressionCodec::type compression_codec = i_colopts.m_codec;
 
         m_pqcol = make_shared<ParquetColumn>(i_path,
                                              data_type,
@@ -319,6 +363,24 @@ SchemaNode::SchemaNode(StringSeq const & i_path,
                                              repetition_type,
                                              encoding,
                                              compression_codec);
+        m_pqcol->set_data_page_v2(i_colopts.m_data_page_v2);
+        m_pqcol->set_page_index(i_colopts.m_page_index);
+        m_pqcol->set_page_checksum(i_colopts.m_page_checksum);
+        m_pqcol->set_compression_level(i_colopts.m_codec_level);
+        if (i_colopts.m_codec_auto)
+            m_pqcol->set_codec_policy(i_colopts.m_codec_policy);
+
+        string path = m_pqcol->path_string();
+        path = path.substr(path.find('.') + 1);
+        if (i_colopts.m_bloom_columns.count(path))
+            m_pqcol->set_bloom_filter(i_colopts.m_bloom_ndv,
+                                      i_colopts.m_bloom_fpp);
+
+        PagePolicy page_policy = i_colopts.m_page_policy;
+        auto pos = i_colopts.m_column_page_bytes.find(path);
+        if (pos != i_colopts.m_column_page_bytes.end())
+            page_policy.m_max_bytes = pos->second;
+        m_pqcol->set_page_policy(page_policy);
     }
 }
 
@@ -381,6 +443,8 @@ SchemaNode::propagate_field(Reflection const * i_reflp,
     else if (m_fdp->is_repeated()) {
         size_t nvals = i_reflp->FieldSize(*i_msg, m_fdp);
         if (nvals > 0) {
+            if (propagate_values(i_reflp, i_msg, nvals, deflvl+1))
+                return;
             for (size_t ndx = 0; ndx < nvals; ++ndx) {
                 if (ndx == 0)
                     propagate_value(i_reflp, i_msg, ndx, replvl, deflvl+1);
@@ -404,6 +468,65 @@ SchemaNode::propagate_field(Reflection const * i_reflp,
     }
 }
 
+bool
+SchemaNode::propagate_values(Reflection const * i_reflp,
+                             Message const * i_msg,
+                             size_t i_nvals,
+                             int deflvl)
+{
+    // Repeated fixed width and boolean scalars go to the column as a
+    // single batch, with the levels propagate_value would give them
+    // one at a time.
+    if (m_dotrace || deflvl != m_maxdeflvl)
+        return false;
+
+    m_replvls.assign(i_nvals, m_maxreplvl);
+    m_replvls[0] = 0;
+
+    switch (m_fdp->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_INT32:
+        m_pqcol->add_values(
+            i_reflp->GetRepeatedField<int32>(*i_msg, m_fdp).data(),
+            i_nvals, m_replvls.data(), NULL);
+        break;
+    case FieldDescriptor::CPPTYPE_INT64:
+        m_pqcol->add_values(
+            reinterpret_cast<int64_t const *>(
+                i_reflp->GetRepeatedField<int64>(*i_msg, m_fdp).data()),
+            i_nvals, m_replvls.data(), NULL);
+        break;
+    case FieldDescriptor::CPPTYPE_UINT32:
+        m_pqcol->add_values(
+            i_reflp->GetRepeatedField<uint32>(*i_msg, m_fdp).data(),
+            i_nvals, m_replvls.data(), NULL);
+        break;
+    case FieldDescriptor::CPPTYPE_UINT64:
+        m_pqcol->add_values(
+            reinterpret_cast<uint64_t const *>(
+                i_reflp->GetRepeatedField<uint64>(*i_msg, m_fdp).data()),
+            i_nvals, m_replvls.data(), NULL);
+        break;
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+        m_pqcol->add_values(
+            i_reflp->GetRepeatedField<double>(*i_msg, m_fdp).data(),
+            i_nvals, m_replvls.data(), NULL);
+        break;
+    case FieldDescriptor::CPPTYPE_FLOAT:
+        m_pqcol->add_values(
+            i_reflp->GetRepeatedField<float>(*i_msg, m_fdp).data(),
+            i_nvals, m_replvls.data(), NULL);
+        break;
+    case FieldDescriptor::CPPTYPE_BOOL:
+        m_pqcol->add_boolean_values(
+            i_reflp->GetRepeatedField<bool>(*i_msg, m_fdp).data(),
+            i_nvals, m_replvls.data(), NULL);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
 void
 SchemaNode::propagate_value(Reflection const * i_reflp,
                             Message const * i_msg,
@@ -562,6 +685,10 @@ Schema::Schema(string const & i_protodir,
                string const & i_infile,
                string const & i_outfile,
                size_t i_rowgrpsz,
+               size_t i_nthreads,
+               bool i_async_flush,
+               string const & i_spilldir,
+               ColumnOptions const & i_colopts,
                bool i_dotrace)
     : m_protofile(i_protofile)
     , m_nrecs(0ULL)
@@ -610,14 +737,34 @@ Schema::Schema(string const & i_protodir,
 
     m_proto = m_dmsgfact.GetPrototype(m_typep);
 
+    StringSeq path = { m_typep->full_name() };
+    m_root = traverse_root(path, m_typep, i_colopts, m_dotrace);
+
+    // Column options for paths which aren't leaves are likely typos.
+    LeafPathCollector leaves;
+    m_root->traverse(leaves);
+    StringSeq unmatched;
+    for (string const & colpath : i_colopts.m_bloom_columns)
+        if (!leaves.m_paths.count(colpath))
+            unmatched.push_back(colpath);
+    for (auto const & entry : i_colopts.m_column_page_bytes)
+        if (!leaves.m_paths.count(entry.first))
+            unmatched.push_back(entry.first);
+    if (!unmatched.empty()) {
+        cerr << "no leaf column matches:";
+        for (string const & colpath : unmatched)
+            cerr << ' ' << colpath;
+        exit(1);
+    }
+
     unlink(i_outfile.c_str());
 
     m_output.reset(new ParquetFile(i_outfile, i_rowgrpsz));
 
-    StringSeq path = { m_typep->full_name() };
-    m_root = traverse_root(path, m_typep, m_dotrace);
-
     m_output->set_root(m_root->column());
+    m_output->set_worker_threads(i_nthreads);
+    m_output->set_async_flush(i_async_flush);
+    m_output->set_spill_directory(i_spilldir);
 }
 
 void
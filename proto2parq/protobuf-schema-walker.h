@@ -7,8 +7,10 @@
 #pragma once
 
 #include <iostream>
+#include <map>
 #include <memory>
 #include <ostream>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -30,6 +32,29 @@ typedef std::vector<SchemaNodeHandle> SchemaNodeSeq;
 
 class NodeTraverser;
 
+// Choices applied to every leaf column of the schema.
+struct ColumnOptions
+{
+    ColumnOptions();
+
+    parquet::Encoding::type m_int_encoding;	// INT32 and INT64 columns
+    parquet::Encoding::type m_string_encoding;	// BYTE_ARRAY columns
+    parquet::Encoding::type m_float_encoding;	// FLOAT and DOUBLE columns
+    parquet::Encoding::type m_bool_encoding;	// BOOLEAN columns
+    bool m_data_page_v2;			// Emit DATA_PAGE_V2 pages
+    bool m_page_index;				// Write column and offset indexes
+    bool m_page_checksum;			// Set PageHeader.crc
+    std::set<std::string> m_bloom_columns;	// Paths, less the root message
+    size_t m_bloom_ndv;				// Distinct values per filter
+    double m_bloom_fpp;				// False positive rate per filter
+    parquet_file::PagePolicy m_page_policy;	// Where pages are cut
+    std::map<std::string, size_t> m_column_page_bytes; // Per path overrides
+    parquet::CompressionCodec::type m_codec;	// Leaf columns
+    int m_codec_level;				// 0 for the codec's default
+    bool m_codec_auto;				// Choose by m_codec_policy
+    parquet_file::CodecPolicy m_codec_policy;
+};
+
 class SchemaNode {
 public:
     SchemaNode(StringSeq const & i_path,
@@ -37,6 +62,7 @@ public:
                google::protobuf::FieldDescriptor const * i_fdp,
                int i_maxreplvl,
                int i_maxdeflvl,
+               ColumnOptions const & i_colopts,
                bool i_dotrace);
 
     void add_child(SchemaNodeHandle const & i_child);
@@ -58,6 +84,11 @@ public:
                          google::protobuf::Message const * i_msg,
                          int replvl, int deflvl);
 
+    bool propagate_values(google::protobuf::Reflection const * i_reflp,
+                          google::protobuf::Message const * i_msg,
+                          size_t i_nvals,
+                          int deflvl);
+
     void propagate_value(google::protobuf::Reflection const * i_reflp,
                          google::protobuf::Message const * i_msg,
                          int ndx,
@@ -71,6 +102,7 @@ public:
     parquet_file::ParquetColumnHandle      m_pqcol;
     SchemaNodeSeq                           m_children;
     bool                                    m_dotrace;
+    std::vector<int16_t>                    m_replvls;	// Of a batch
 };
 
 class NodeTraverser
@@ -88,6 +120,10 @@ public:
            std::string const & i_infile,
            std::string const & i_outfile,
            size_t i_rowgrpsz,
+           size_t i_nthreads,
+           bool i_async_flush,
+           std::string const & i_spilldir,
+           ColumnOptions const & i_colopts,
            bool i_dotrace);
 
     void dump(std::ostream & ostrm);